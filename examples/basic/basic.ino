@@ -3,7 +3,6 @@
 #define SerialMon Serial
 #include <TinyDebug.h>
 
-#define GPS_BAUDRATE 9600
 #define MODEM_BAUDRATE 38400
 
 #define FONA_RX 9
@@ -46,6 +45,15 @@ void onPinCode(void *sender, EventArgs *e)
 {
 }
 
+GNSSFix lastFix;
+
+void onGNSSFix(void *sender, EventArgs *e)
+{
+  GNSSFix *fix = (GNSSFix *)e;
+  if (fix->fixed)
+    lastFix = *fix;
+}
+
 void setup()
 {
 #ifdef SerialMon
@@ -54,18 +62,21 @@ void setup()
   SerialMon.println(F("\nBooting..."));
 #endif
 
-  Serial1.begin(GPS_BAUDRATE);
-
   SerialAT.begin(MODEM_BAUDRATE);
 
   modem.resetting += onResetting;
   modem.pinCode += onPinCode;
+  modem.gnssFix += onGNSSFix;
 
   modem.allowRoaming(true);
   modem.reset();
 
   strcpy(imei, modem.getIMEI());
 
+  // SIM808/SIM868: position from the modem's own GNSS, a fix every 10 s
+  modem.enableGNSS(true);
+  modem.enableGNSSURC(10);
+
   while (!modem.isRegistered()) {
     delay(100);
   }
@@ -81,7 +92,7 @@ void registerDevice()
 
   modem.postHTTP("", NULL,
     []() -> uint16_t { return strlen(buffer); },
-    [](const SoftwareSerial & serial) {
+    [](Stream & serial) {
       serial.print(buffer);
     },
     [](const uint16_t statusCode) {  },
@@ -97,4 +108,5 @@ void registerDevice()
 
 void loop()
 {
+  modem.poll(); // picks up the +UGNSINF fixes
 }
@@ -0,0 +1,102 @@
+#include "AdaptiveTimeout.h"
+
+AdaptiveTimeout::AdaptiveTimeout()
+{
+  memset(_entries, 0, sizeof(_entries));
+
+  configure(100, 60000);
+}
+
+void AdaptiveTimeout::configure(uint16_t floor, uint16_t ceiling, uint8_t percentile, uint8_t margin)
+{
+  _floor = floor;
+  _ceiling = ceiling;
+  _percentile = percentile;
+  _margin = margin;
+}
+
+uint16_t AdaptiveTimeout::timeout(const void *command, uint16_t nominal)
+{
+  uint32_t t = latency(command, _percentile);
+
+  if (t == 0)
+    return nominal;
+
+  t *= _margin;
+  if (t < _floor)
+    t = _floor;
+  if (t > _ceiling)
+    t = _ceiling;
+
+  return t;
+}
+
+void AdaptiveTimeout::record(const void *command, uint16_t latency)
+{
+  Entry *e = find(command);
+  if (e == NULL)
+  {
+    // a free slot, or the one of the least used command: the commands
+    // that are sent often keep their history
+    e = leastUsed();
+
+    memset(e, 0, sizeof(Entry));
+    e->command = command;
+  }
+
+  uint8_t bucket = 0;
+  while (bucket < ADAPTIVE_TIMEOUT_BUCKETS - 1 && latency >= (16U << bucket))
+    bucket++;
+
+  if (e->counts[bucket] == 255)
+  {
+    // age the history, recent samples weigh more
+    e->samples = 0;
+    for (uint8_t i = 0; i < ADAPTIVE_TIMEOUT_BUCKETS; i++)
+    {
+      e->counts[i] >>= 1;
+      e->samples += e->counts[i];
+    }
+  }
+
+  e->counts[bucket]++;
+  e->samples++;
+}
+
+uint16_t AdaptiveTimeout::latency(const void *command, uint8_t percentile)
+{
+  Entry *e = find(command);
+  if (e == NULL || e->samples < ADAPTIVE_TIMEOUT_MIN_SAMPLES)
+    return 0;
+
+  uint32_t wanted = ((uint32_t)e->samples * percentile + 99) / 100;
+  uint32_t seen = 0;
+  uint8_t bucket = 0;
+  for (; bucket < ADAPTIVE_TIMEOUT_BUCKETS - 1; bucket++)
+  {
+    seen += e->counts[bucket];
+    if (seen >= wanted)
+      break;
+  }
+
+  return (16U << bucket) - 1;
+}
+
+AdaptiveTimeout::Entry *AdaptiveTimeout::find(const void *command)
+{
+  for (uint8_t i = 0; i < ADAPTIVE_TIMEOUT_COMMANDS; i++)
+    if (_entries[i].command == command)
+      return &_entries[i];
+
+  return NULL;
+}
+
+AdaptiveTimeout::Entry *AdaptiveTimeout::leastUsed()
+{
+  Entry *least = &_entries[0];
+  for (uint8_t i = 1; i < ADAPTIVE_TIMEOUT_COMMANDS; i++)
+    if (_entries[i].samples < least->samples)
+      least = &_entries[i];
+
+  return least;
+}
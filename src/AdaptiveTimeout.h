@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef ADAPTIVE_TIMEOUT_COMMANDS
+#define ADAPTIVE_TIMEOUT_COMMANDS 8
+#endif
+
+// 12 buckets of doubling width: < 16 ms, < 32 ms, ..., < 32768 ms
+#define ADAPTIVE_TIMEOUT_BUCKETS 12
+#define ADAPTIVE_TIMEOUT_MIN_SAMPLES 8
+
+// Learns how long the modem takes to answer each command, and derives the
+// timeout to use from a high percentile of that. Commands are identified by
+// the address of their (flash) string, latencies are kept per command in a
+// small log2 histogram. Until a command has enough samples its nominal
+// timeout is used. When the table is full, a new command takes the place of
+// the one with the fewest samples. A timed out command counts as having taken its full
+// timeout, so a too tight timeout grows again by itself.
+//
+//   AdaptiveTimeout adaptive;
+//   adaptive.configure(200, 30000);
+//   modem.setAdaptiveTimeout(&adaptive);
+class AdaptiveTimeout
+{
+public:
+        AdaptiveTimeout();
+
+        // timeout = clamp(margin * percentile latency, floor, ceiling)
+        void configure(uint16_t floor, uint16_t ceiling, uint8_t percentile = 95, uint8_t margin = 2);
+
+        uint16_t timeout(const void *command, uint16_t nominal);
+        void record(const void *command, uint16_t latency);
+
+        // upper bound of the bucket holding the given percentile, 0 if unknown
+        uint16_t latency(const void *command, uint8_t percentile);
+
+protected:
+        struct Entry
+        {
+                const void *command;
+                uint16_t samples;
+                uint8_t counts[ADAPTIVE_TIMEOUT_BUCKETS];
+        };
+
+        Entry _entries[ADAPTIVE_TIMEOUT_COMMANDS];
+
+        uint16_t _floor;
+        uint16_t _ceiling;
+        uint8_t _percentile;
+        uint8_t _margin;
+
+        Entry *find(const void *command);
+        Entry *leastUsed();
+};
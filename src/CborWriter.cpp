@@ -0,0 +1,111 @@
+#include "CborWriter.h"
+
+void CborWriter::writeHead(uint8_t major, uint32_t v)
+{
+  major <<= 5;
+
+  if (v < 24)
+  {
+    _out.write((uint8_t)(major | v));
+  }
+  else if (v <= 0xFF)
+  {
+    _out.write((uint8_t)(major | 24));
+    _out.write((uint8_t)v);
+  }
+  else if (v <= 0xFFFF)
+  {
+    _out.write((uint8_t)(major | 25));
+    _out.write((uint8_t)(v >> 8));
+    _out.write((uint8_t)v);
+  }
+  else
+  {
+    _out.write((uint8_t)(major | 26));
+    _out.write((uint8_t)(v >> 24));
+    _out.write((uint8_t)(v >> 16));
+    _out.write((uint8_t)(v >> 8));
+    _out.write((uint8_t)v);
+  }
+}
+
+void CborWriter::writeInt(int32_t v)
+{
+  if (v >= 0)
+    writeHead(0, (uint32_t)v);
+  else
+    writeHead(1, (uint32_t)(-1 - v)); // negative integers are stored as -1 - n
+}
+
+void CborWriter::writeFloat(float v)
+{
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+
+  _out.write((uint8_t)0xFA);
+  _out.write((uint8_t)(bits >> 24));
+  _out.write((uint8_t)(bits >> 16));
+  _out.write((uint8_t)(bits >> 8));
+  _out.write((uint8_t)bits);
+}
+
+void CborWriter::writeString(const char *s)
+{
+  uint16_t len = strlen(s);
+
+  writeHead(3, len);
+  _out.write((const uint8_t *)s, len);
+}
+
+void CborWriter::writeString(const __FlashStringHelper *s)
+{
+  const char *p = (const char *)s;
+  uint16_t len = strlen_P(p);
+
+  writeHead(3, len);
+  for (uint16_t i = 0; i < len; i++)
+    _out.write((uint8_t)pgm_read_byte(p + i));
+}
+
+void CborWriter::writeBytes(const uint8_t *data, uint16_t len)
+{
+  writeHead(2, len);
+  _out.write(data, len);
+}
+
+void TrackEncoder::begin()
+{
+  _points = 0;
+  _cbor.beginArray();
+}
+
+void TrackEncoder::add(uint32_t time, int32_t lat, int32_t lon, int16_t alt)
+{
+  _cbor.beginArray(4);
+
+  if (_points == 0)
+  {
+    _cbor.writeUInt(time);
+    _cbor.writeInt(lat);
+    _cbor.writeInt(lon);
+    _cbor.writeInt(alt);
+  }
+  else
+  {
+    _cbor.writeInt((int32_t)(time - _time));
+    _cbor.writeInt(lat - _lat);
+    _cbor.writeInt(lon - _lon);
+    _cbor.writeInt(alt - _alt);
+  }
+
+  _time = time;
+  _lat = lat;
+  _lon = lon;
+  _alt = alt;
+  _points++;
+}
+
+void TrackEncoder::end()
+{
+  _cbor.end();
+}
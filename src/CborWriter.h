@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Streaming CBOR (RFC 7049) encoder. Items are written to the Print as they
+// are added, so a body never has to be buffered in RAM. To get the length
+// up front (AT+HTTPDATA, AT+CIPSEND), encode once into a ByteCounter and
+// then again into the modem's Stream:
+//
+//   uint16_t measureBody() { ByteCounter c; encode(c); return c.count(); }
+//   void streamBody(Stream &s) { encode(s); }
+class CborWriter
+{
+public:
+        CborWriter(Print &out) : _out(out) {}
+
+        void beginArray(uint32_t n) { writeHead(4, n); }
+        void beginMap(uint32_t n) { writeHead(5, n); }
+        void beginArray() { _out.write((uint8_t)0x9F); } // indefinite length
+        void beginMap() { _out.write((uint8_t)0xBF); }    // indefinite length
+        void end() { _out.write((uint8_t)0xFF); }         // closes an indefinite array/map
+
+        void writeUInt(uint32_t v) { writeHead(0, v); }
+        void writeInt(int32_t v);
+        void writeBool(bool v) { _out.write((uint8_t)(v ? 0xF5 : 0xF4)); }
+        void writeNull() { _out.write((uint8_t)0xF6); }
+        void writeFloat(float v);
+        void writeString(const char *s);
+        void writeString(const __FlashStringHelper *s);
+        void writeBytes(const uint8_t *data, uint16_t len);
+
+protected:
+        Print &_out;
+
+        void writeHead(uint8_t major, uint32_t v);
+};
+
+// Print that only counts what is written to it.
+class ByteCounter : public Print
+{
+public:
+        ByteCounter() : _count(0) {}
+
+        size_t write(uint8_t) { _count++; return 1; }
+        size_t write(const uint8_t *, size_t len) { _count += len; return len; }
+
+        uint16_t count() const { return _count; }
+        void reset() { _count = 0; }
+
+private:
+        uint16_t _count;
+};
+
+// Compact GPS track on top of CborWriter. A track is an indefinite array of
+// points; the first point is absolute, every next one holds the difference
+// with its predecessor, which mostly fits in 1 to 3 bytes per field:
+//
+//   [[time, lat, lon, alt], [dtime, dlat, dlon, dalt], ...]
+//
+// time in seconds, lat/lon in 1e-6 degrees, alt in meters.
+class TrackEncoder
+{
+public:
+        TrackEncoder(Print &out) : _cbor(out), _points(0) {}
+
+        void begin();
+        void add(uint32_t time, int32_t lat, int32_t lon, int16_t alt = 0);
+        void end();
+
+        uint16_t points() const { return _points; }
+
+protected:
+        CborWriter _cbor;
+        uint16_t _points;
+
+        uint32_t _time;
+        int32_t _lat;
+        int32_t _lon;
+        int16_t _alt;
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+// Sharing one modem between tasks (ESP32/FreeRTOS, or threads on a host).
+//
+// TinySIM800 itself is not thread safe: every call uses the one replybuffer
+// and the one Stream. So a single owner task runs all modem commands, and
+// other tasks submit them through a bounded lock-free queue:
+//
+//   CommandQueue<8> commands;
+//
+//   // owner task
+//   for (;;) { commands.process(modem); modem.poll(); delay(10); }
+//
+//   // any other task
+//   bool sendPosition(TinySIM800 &modem, void *context) { return modem.postHTTP(...); }
+//
+//   CommandCompletion completion;
+//   ModemCommand command = {sendPosition, NULL, NULL, &completion};
+//   if (commands.submit(command) && completion.wait(30000) && completion.ok())
+//     ...
+//
+// Needs <atomic>, so not available on AVR.
+
+#if !defined(__AVR__)
+
+#include <atomic>
+
+#include "TinySIM800.h"
+
+// Signalled by the owner task when a command has run; a submitter can poll
+// or wait on it instead of passing a done callback.
+class CommandCompletion
+{
+public:
+        CommandCompletion() : _state(Pending) {}
+
+        void reset() { _state.store(Pending, std::memory_order_relaxed); }
+        void complete(bool ok) { _state.store(ok ? Succeeded : Failed, std::memory_order_release); }
+
+        bool ready() const { return _state.load(std::memory_order_acquire) != Pending; }
+        bool ok() const { return _state.load(std::memory_order_acquire) == Succeeded; }
+
+        // false on timeout (ms)
+        bool wait(uint32_t timeout)
+        {
+                uint32_t start = millis();
+                while (!ready())
+                {
+                        if (millis() - start > timeout)
+                                return false;
+                        delay(1);
+                }
+                return true;
+        }
+
+protected:
+        enum
+        {
+                Pending,
+                Succeeded,
+                Failed
+        };
+
+        std::atomic<uint8_t> _state;
+};
+
+struct ModemCommand
+{
+        bool (*run)(TinySIM800 &modem, void *context);
+        void (*done)(bool ok, void *context); // called on the owner task, may be NULL
+        void *context;
+        CommandCompletion *completion; // may be NULL
+};
+
+// Bounded multi-producer, single-consumer queue (Vyukov): every slot has a
+// sequence number telling producers and the consumer whose turn it is, so
+// submit() only needs one compare-and-swap and never blocks. Size must be a
+// power of two.
+template <uint8_t Size>
+class CommandQueue
+{
+        static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Size must be a power of two");
+
+public:
+        CommandQueue()
+        {
+                for (uint8_t i = 0; i < Size; i++)
+                        _slots[i].sequence.store(i, std::memory_order_relaxed);
+                _tail.store(0, std::memory_order_relaxed);
+                _head = 0;
+                _rejected.store(0, std::memory_order_relaxed);
+        }
+
+        // From any task. False when the queue is full.
+        bool submit(const ModemCommand &command)
+        {
+                if (command.completion)
+                        command.completion->reset();
+
+                uint16_t pos = _tail.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                        Slot &slot = _slots[pos & (Size - 1)];
+                        uint16_t sequence = slot.sequence.load(std::memory_order_acquire);
+                        int16_t diff = (int16_t)(uint16_t)(sequence - pos);
+
+                        if (diff == 0)
+                        {
+                                if (_tail.compare_exchange_weak(pos, (uint16_t)(pos + 1), std::memory_order_relaxed))
+                                {
+                                        slot.command = command;
+                                        slot.sequence.store((uint16_t)(pos + 1), std::memory_order_release);
+                                        return true;
+                                }
+                                // pos was reloaded by the failed exchange
+                        }
+                        else if (diff < 0)
+                        {
+                                _rejected.fetch_add(1, std::memory_order_relaxed);
+                                return false;
+                        }
+                        else
+                                pos = _tail.load(std::memory_order_relaxed);
+                }
+        }
+
+        // Owner task only. Runs up to max queued commands, returns how many ran.
+        uint8_t process(TinySIM800 &modem, uint8_t max = Size)
+        {
+                uint8_t count = 0;
+                ModemCommand command;
+
+                while (count < max && take(command))
+                {
+                        bool ok = command.run(modem, command.context);
+                        if (command.done)
+                                command.done(ok, command.context);
+                        if (command.completion)
+                                command.completion->complete(ok);
+                        count++;
+                }
+
+                return count;
+        }
+
+        // submits refused because the queue was full
+        uint16_t rejected() const { return _rejected.load(std::memory_order_relaxed); }
+
+protected:
+        struct Slot
+        {
+                std::atomic<uint16_t> sequence;
+                ModemCommand command;
+        };
+
+        Slot _slots[Size];
+        std::atomic<uint16_t> _tail; // next position to submit to
+        uint16_t _head;              // next position to take, owner task only
+        std::atomic<uint16_t> _rejected;
+
+        bool take(ModemCommand &command)
+        {
+                Slot &slot = _slots[_head & (Size - 1)];
+                uint16_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+                if (sequence != (uint16_t)(_head + 1))
+                        return false; // empty, or the producer is not done writing
+
+                command = slot.command;
+                slot.sequence.store((uint16_t)(_head + Size), std::memory_order_release);
+                _head++;
+
+                return true;
+        }
+};
+
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+
+// Every AT command the driver sends, and every reply (or reply prefix) it
+// looks for, in one place. The lists generate an enum here and, in
+// TinySIM800.cpp, one PROGMEM string per entry: a command or reply used in
+// several places is stored once. Commands are stored without their "AT",
+// which is sent by TinySIM800::sendCommand. Commands that take parameters
+// end where the parameters start, except where the parameters make it a
+// different operation (opening or closing the bearer, GET or POST): those
+// get an entry each, so AdaptiveTimeout learns them apart. Replies ending in
+// ':', ' ' or ',' are prefixes (TinySIM800::isReplyPrefix), the URCs among
+// them are handled in TinySIM800::readline.
+
+#define SIM800_COMMANDS(X)                                                   \
+        X(CMD_AT, "")                                                        \
+        X(CMD_ATE0, "E0")                                                    \
+        X(CMD_ATI, "I")                                                      \
+        X(CMD_AT_W, "&W")                                                    \
+        X(CMD_CVHU, "+CVHU=")                                                \
+        X(CMD_CREG, "+CREG=")                                                \
+        X(CMD_CREG_READ, "+CREG?")                                           \
+        X(CMD_CGREG, "+CGREG=")                                              \
+        X(CMD_CGREG_READ, "+CGREG?")                                         \
+        X(CMD_IPREX, "+IPREX=")                                              \
+        X(CMD_IFC, "+IFC=")                                                  \
+        X(CMD_CBC, "+CBC")                                                   \
+        X(CMD_GSN, "+GSN")                                                   \
+        X(CMD_GMR, "+GMR")                                                   \
+        X(CMD_CSCLK, "+CSCLK=")                                              \
+        X(CMD_CSQ, "+CSQ")                                                   \
+        X(CMD_CENG, "+CENG=")                                                \
+        X(CMD_CENG_READ, "+CENG?")                                           \
+        X(CMD_CUSD, "+CUSD=")                                                \
+        X(CMD_CLTS, "+CLTS=")                                                \
+        X(CMD_CCLK_READ, "+CCLK?")                                           \
+        X(CMD_CGNSPWR, "+CGNSPWR=")                                          \
+        X(CMD_CGNSINF, "+CGNSINF")                                           \
+        X(CMD_CGNSURC, "+CGNSURC=")                                          \
+        X(CMD_SAPBR_OPEN, "+SAPBR=1,1")                                      \
+        X(CMD_SAPBR_CLOSE, "+SAPBR=0,1")                                     \
+        X(CMD_SAPBR_CONTYPE, "+SAPBR=3,1,\"CONTYPE\",\"GPRS\"")              \
+        X(CMD_SAPBR_APN, "+SAPBR=3,1,\"APN\",")                              \
+        X(CMD_SAPBR_USER, "+SAPBR=3,1,\"USER\",")                            \
+        X(CMD_SAPBR_PWD, "+SAPBR=3,1,\"PWD\",")                              \
+        X(CMD_CSTT, "+CSTT=\"")                                              \
+        X(CMD_CIICR, "+CIICR")                                               \
+        X(CMD_CGATT, "+CGATT=")                                              \
+        X(CMD_CGATT_READ, "+CGATT?")                                         \
+        X(CMD_CIPSHUT, "+CIPSHUT")                                           \
+        X(CMD_CIPMUX, "+CIPMUX=")                                            \
+        X(CMD_CIPRXGET, "+CIPRXGET=")                                        \
+        X(CMD_CIPRXGET_AVAILABLE, "+CIPRXGET=4")                             \
+        X(CMD_CDNSGIP, "+CDNSGIP=\"")                                        \
+        X(CMD_CIPSTART, "+CIPSTART=\"TCP\",\"")                              \
+        X(CMD_CIPCLOSE, "+CIPCLOSE")                                         \
+        X(CMD_CIPSTATUS, "+CIPSTATUS")                                       \
+        X(CMD_CIPSEND, "+CIPSEND=")                                          \
+        X(CMD_HTTPINIT, "+HTTPINIT")                                         \
+        X(CMD_HTTPTERM, "+HTTPTERM")                                         \
+        X(CMD_HTTPPARA_CID, "+HTTPPARA=\"CID\",1")                           \
+        X(CMD_HTTPPARA_URL, "+HTTPPARA=\"URL\",\"")                          \
+        X(CMD_HTTPPARA_CONTENT, "+HTTPPARA=\"CONTENT\",\"application/json\"\r\n") \
+        X(CMD_HTTPPARA_USERDATA, "+HTTPPARA=\"USERDATA\",\"")                \
+        X(CMD_HTTPPARA_BREAK, "+HTTPPARA=\"BREAK\",")                        \
+        X(CMD_HTTPPARA_BREAKEND, "+HTTPPARA=\"BREAKEND\",")                  \
+        X(CMD_HTTPDATA, "+HTTPDATA=")                                        \
+        X(CMD_HTTPACTION_GET, "+HTTPACTION=0")                               \
+        X(CMD_HTTPACTION_POST, "+HTTPACTION=1")                              \
+        X(CMD_HTTPREAD, "+HTTPREAD=")
+
+#define SIM800_REPLIES(X)                                                    \
+        X(REPLY_OK, "OK")                                                    \
+        X(REPLY_AT, "AT")                                                    \
+        X(REPLY_SHUT_OK, "SHUT OK")                                          \
+        X(REPLY_CONNECT_OK, "CONNECT OK")                                    \
+        X(REPLY_CLOSE_OK, "CLOSE OK")                                        \
+        X(REPLY_SEND_OK, "SEND OK")                                          \
+        X(REPLY_DOWNLOAD, "DOWNLOAD")                                        \
+        X(REPLY_STATE_CONNECT_OK, "STATE: CONNECT OK")                       \
+        X(REPLY_STATE_PDP_DEACT, "STATE: PDP DEACT")                         \
+        X(REPLY_CLOSED, "CLOSED")                                            \
+        X(REPLY_PDP_DEACT, "+PDP: DEACT")                                    \
+        X(REPLY_CREG, "+CREG:")                                              \
+        X(REPLY_CGREG, "+CGREG:")                                            \
+        X(REPLY_UGNSINF, "+UGNSINF: ")                                       \
+        X(REPLY_PSNWID, "*PSNWID:")                                          \
+        X(REPLY_PSUTTZ, "*PSUTTZ:")                                          \
+        X(REPLY_DST, "DST:")                                                 \
+        X(REPLY_CTZV, "+CTZV:")                                              \
+        X(REPLY_CBC, "+CBC: ")                                               \
+        X(REPLY_CSQ, "+CSQ: ")                                               \
+        X(REPLY_CGATT, "+CGATT: ")                                           \
+        X(REPLY_CCLK, "+CCLK: ")                                             \
+        X(REPLY_CENG, "+CENG: ")                                             \
+        X(REPLY_CENG_SERVING, "+CENG: 0,\"")                                 \
+        X(REPLY_CGNSINF, "+CGNSINF: ")                                       \
+        X(REPLY_CUSD, "+CUSD: ")                                             \
+        X(REPLY_CDNSGIP, "+CDNSGIP: ")                                       \
+        X(REPLY_CIPRXGET_2, "+CIPRXGET: 2,")                                 \
+        X(REPLY_CIPRXGET_4, "+CIPRXGET: 4,")                                 \
+        X(REPLY_HTTPACTION, "+HTTPACTION:")                                  \
+        X(REPLY_HTTPACTION_0, "+HTTPACTION: 0,")                             \
+        X(REPLY_HTTPACTION_1, "+HTTPACTION: 1,")                             \
+        X(REPLY_HTTPREAD, "+HTTPREAD: ")
+
+#define SIM800_ENUM(id, text) id,
+
+enum ATCommand : uint8_t
+{
+        SIM800_COMMANDS(SIM800_ENUM)
+        CMD_COUNT
+};
+
+enum ATReply : uint8_t
+{
+        SIM800_REPLIES(SIM800_ENUM)
+        REPLY_COUNT
+};
+
+#undef SIM800_ENUM
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <Arduino.h>
+
+// CRC-32 (IEEE 802.3, as used by zip and PNG), computed incrementally.
+class Crc32
+{
+public:
+        Crc32() { reset(); }
+
+        void reset() { _crc = 0xFFFFFFFF; }
+        void update(const uint8_t *data, uint16_t len);
+        uint32_t value() const { return ~_crc; }
+
+private:
+        uint32_t _crc;
+};
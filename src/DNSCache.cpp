@@ -0,0 +1,67 @@
+#include "DNSCache.h"
+
+DNSCache::DNSCache(uint32_t ttl)
+    : _ttl(ttl)
+{
+  clear();
+}
+
+const char *DNSCache::lookup(const char *host)
+{
+  Entry *e = find(host);
+  if (e == NULL)
+    return NULL;
+
+  if (millis() - e->resolved > _ttl)
+  {
+    e->host[0] = 0;
+    return NULL;
+  }
+
+  return e->ip;
+}
+
+void DNSCache::store(const char *host, const char *ip)
+{
+  if (strlen(host) >= DNS_HOST_LEN || strlen(ip) >= DNS_IP_LEN)
+    return;
+
+  // same host, a free slot, or else the oldest
+  Entry *e = find(host);
+  for (uint8_t i = 0; e == NULL && i < DNS_CACHE_SIZE; i++)
+    if (_entries[i].host[0] == 0)
+      e = &_entries[i];
+  if (e == NULL)
+  {
+    e = &_entries[0];
+    for (uint8_t i = 1; i < DNS_CACHE_SIZE; i++)
+      if (millis() - _entries[i].resolved > millis() - e->resolved)
+        e = &_entries[i];
+  }
+
+  strcpy(e->host, host);
+  strcpy(e->ip, ip);
+  e->resolved = millis();
+}
+
+void DNSCache::invalidate(const char *host)
+{
+  Entry *e = find(host);
+  if (e != NULL)
+    e->host[0] = 0;
+}
+
+void DNSCache::clear()
+{
+  for (uint8_t i = 0; i < DNS_CACHE_SIZE; i++)
+    _entries[i].host[0] = 0;
+}
+
+DNSCache::Entry *DNSCache::find(const char *host)
+{
+  for (uint8_t i = 0; i < DNS_CACHE_SIZE; i++)
+    if (_entries[i].host[0] != 0 && strcmp(_entries[i].host, host) == 0)
+      return &_entries[i];
+
+  return NULL;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef DNS_CACHE_SIZE
+#define DNS_CACHE_SIZE 2
+#endif
+#define DNS_HOST_LEN 32
+#define DNS_IP_LEN 16
+
+// Small fixed table of resolved host names. Attach it to the modem with
+// setDNSCache() and TCPconnect resolves host names once (AT+CDNSGIP) and
+// then connects by IP address until the entry expires.
+class DNSCache
+{
+public:
+        DNSCache(uint32_t ttl = 600000UL);
+
+        void setTTL(uint32_t ttl) { _ttl = ttl; }
+
+        // IP address of host, NULL if not cached or expired
+        const char *lookup(const char *host);
+        void store(const char *host, const char *ip);
+        void invalidate(const char *host);
+        void clear();
+
+protected:
+        struct Entry
+        {
+                char host[DNS_HOST_LEN];
+                char ip[DNS_IP_LEN];
+                uint32_t resolved; // millis()
+        };
+
+        Entry _entries[DNS_CACHE_SIZE];
+        uint32_t _ttl;
+
+        Entry *find(const char *host);
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Crc32.h"
+#include "Sha256.h"
+
+// Where downloaded data goes: a flash partition, an SD card file, ...
+// Blocks arrive in order; offset is the position in the file. They pass
+// through the driver's reply buffer, so a block is at most 254 bytes
+// whatever the chunk size of the download: buffer writes that want larger
+// or aligned pages (flash) in the sink.
+class DownloadSink
+{
+public:
+        virtual bool write(uint32_t offset, const uint8_t *data, uint16_t len) = 0;
+};
+
+// Progress of a download. Keep it around after a failed download and pass
+// it in again to resume from where it stopped; the checksums carry on.
+struct DownloadState
+{
+        DownloadState(Sha256 *sha = NULL) : offset(0), complete(false), sha(sha), received(0), elapsed(0) {}
+
+        uint32_t offset; // bytes written to the sink
+        bool complete;
+
+        Crc32 crc;
+        Sha256 *sha; // optional
+
+        uint32_t received; // over all attempts
+        uint32_t elapsed;  // ms, over all attempts
+
+        uint32_t bytesPerSecond() const { return elapsed > 0 ? (uint64_t)received * 1000 / elapsed : 0; }
+};
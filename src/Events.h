@@ -11,6 +11,8 @@ class Event<R(*)(void*, EventArgs*)>
 	typedef R(*FuncType)(void*, EventArgs*);
 	FuncType ls;
 public:
+	Event() : ls(NULL) {}
+
 	Event<FuncType>& operator+=(FuncType t)
 	{
 		ls = t;
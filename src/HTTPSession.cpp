@@ -0,0 +1,333 @@
+#include <Arduino.h>
+
+#include "HTTPSession.h"
+#include "CborWriter.h"
+
+enum
+{
+  StatusLine,
+  Headers,
+  Body,
+  ChunkSize,
+  ChunkData,
+  ChunkEnd,
+  Trailers,
+  UntilClose,
+  Complete
+};
+
+HTTPSession *HTTPSession::_sending = NULL;
+
+HTTPSession::HTTPSession(TinySIM800 &modem)
+    : _modem(modem)
+{
+  _host = NULL;
+  _connected = false;
+  _outstanding = 0;
+  _headMask = 0;
+  _method = NULL;
+  _path = NULL;
+  _headers = NULL;
+  _bodyLength = 0;
+  _ptrStreamBody = NULL;
+  _requestLength = 0;
+  _state = Complete;
+  _remaining = 0;
+  _lineLen = 0;
+  _rxLen = 0;
+  _rxPos = 0;
+  _avail = 0;
+}
+
+bool HTTPSession::connect(char *host, uint16_t port)
+{
+  _host = host;
+  _outstanding = 0;
+  _headMask = 0;
+  _rxLen = 0;
+  _rxPos = 0;
+  _avail = 0;
+
+  _connected = _modem.TCPconnect(host, port);
+  return _connected;
+}
+
+void HTTPSession::close()
+{
+  if (_connected)
+    _modem.TCPclose();
+
+  _connected = false;
+  _outstanding = 0;
+  _headMask = 0;
+  _rxLen = 0;
+  _rxPos = 0;
+  _avail = 0;
+}
+
+// Send a request without waiting for its response.
+bool HTTPSession::request(const char *method, const char *path, const char *headers,
+                          uint16_t (*ptrMeasureBody)(),
+                          void (*ptrStreamBody)(Stream &))
+{
+  if (!_connected || _outstanding >= HTTP_MAX_PIPELINE)
+    return false;
+
+  _method = method;
+  _path = path;
+  _headers = headers;
+  _bodyLength = ptrMeasureBody ? ptrMeasureBody() : 0;
+  _ptrStreamBody = ptrStreamBody;
+
+  ByteCounter counter;
+  writeRequest(counter);
+  if ((uint32_t)counter.count() + _bodyLength > HTTP_MAX_SEND)
+  {
+    DEBUG_PRINTLN(F("HTTP: request too large"));
+    return false;
+  }
+  _requestLength = counter.count() + _bodyLength;
+
+  _sending = this;
+  bool sent = _modem.TCPsend(measureRequest, streamRequest);
+  _sending = NULL;
+
+  if (!sent)
+  {
+    close();
+    return false;
+  }
+
+  if (strcmp(method, "HEAD") == 0)
+    _headMask |= 1 << _outstanding;
+  _outstanding++;
+
+  return true;
+}
+
+// Read the response to the oldest outstanding request. Its body goes to
+// sink (or nowhere), starting at offset 0.
+bool HTTPSession::response(HTTPResponse &response, DownloadSink *sink, uint16_t timeout)
+{
+  if (_outstanding == 0)
+    return false;
+
+  memset(&response, 0, sizeof(response));
+  response.contentLength = -1;
+  _state = StatusLine;
+  _lineLen = 0;
+
+  bool ok = true;
+  uint32_t last = millis();
+
+  while (ok && _state != Complete)
+  {
+    if (_rxPos < _rxLen)
+    {
+      ok = parse(response, sink);
+      continue;
+    }
+
+    // only ask the modem again when what it had is read
+    if (_avail == 0)
+      _avail = _modem.TCPavailable();
+    if (_avail == 0)
+    {
+      uint32_t idle = millis() - last;
+      if (idle > timeout)
+      {
+        DEBUG_PRINTLN(F("HTTP: timeout"));
+        ok = false;
+      }
+      else if (idle > 1000 && !_modem.TCPconnected())
+      {
+        // closed by the server: the end of a body without length, else an error
+        _connected = false;
+        if (_state == UntilClose)
+          _state = Complete;
+        else
+          ok = false;
+      }
+      else
+        delay(100);
+      continue;
+    }
+
+    _rxPos = 0;
+    _rxLen = _modem.TCPread(_rx, _avail < sizeof(_rx) ? _avail : sizeof(_rx), &_avail);
+    if (_rxLen == 0)
+    {
+      _avail = 0;
+      ok = false;
+    }
+    last = millis();
+  }
+
+  _outstanding--;
+  _headMask >>= 1;
+
+  // after a broken response the next one can't be found in the stream
+  if (!ok || !response.keepAlive)
+    close();
+
+  return ok;
+}
+
+void HTTPSession::writeRequest(Print &out)
+{
+  out.print(_method);
+  out.print(' ');
+  out.print(_path);
+  out.print(F(" HTTP/1.1\r\nHost: "));
+  out.print(_host);
+  out.print(F("\r\n"));
+  if (_ptrStreamBody)
+  {
+    out.print(F("Content-Length: "));
+    out.print(_bodyLength);
+    out.print(F("\r\n"));
+  }
+  if (_headers)
+    out.print(_headers);
+  out.print(F("\r\n"));
+}
+
+// Consume buffered bytes up to the end of the response; bytes past it
+// belong to the next (pipelined) response and stay in _rx.
+bool HTTPSession::parse(HTTPResponse &response, DownloadSink *sink)
+{
+  while (_rxPos < _rxLen && _state != Complete)
+  {
+    if (_state == Body || _state == ChunkData || _state == UntilClose)
+    {
+      uint16_t n = _rxLen - _rxPos;
+      if (_state != UntilClose && n > _remaining)
+        n = _remaining;
+
+      if (sink && !sink->write(response.received, _rx + _rxPos, n))
+        return false;
+      response.received += n;
+      _rxPos += n;
+
+      if (_state != UntilClose)
+      {
+        _remaining -= n;
+        if (_remaining == 0)
+          _state = (_state == Body) ? Complete : ChunkEnd;
+      }
+      continue;
+    }
+
+    char c = _rx[_rxPos++];
+    if (c == '\r')
+      continue;
+    if (c != '\n')
+    {
+      if (_lineLen < sizeof(_line) - 1) // longer header lines are cut off
+        _line[_lineLen++] = c;
+      continue;
+    }
+
+    _line[_lineLen] = 0;
+    _lineLen = 0;
+    if (!parseLine(response))
+      return false;
+  }
+
+  return true;
+}
+
+bool HTTPSession::parseLine(HTTPResponse &response)
+{
+  switch (_state)
+  {
+  case StatusLine:
+    if (_line[0] == 0)
+      return true;
+    if (strncmp(_line, "HTTP/1.", 7) != 0 || strlen(_line) < 12)
+      return false;
+    response.status = atoi(_line + 9);
+    response.keepAlive = (_line[7] == '1'); // HTTP/1.0 closes by default
+    response.contentLength = -1;
+    response.chunked = false;
+    _state = Headers;
+    return true;
+
+  case Headers:
+    if (_line[0] != 0)
+    {
+      if (strncasecmp_P(_line, PSTR("Content-Length:"), 15) == 0)
+        response.contentLength = atol(_line + 15);
+      else if (strncasecmp_P(_line, PSTR("Transfer-Encoding:"), 18) == 0)
+        response.chunked = (strstr_P(_line + 18, PSTR("chunked")) != NULL);
+      else if (strncasecmp_P(_line, PSTR("Connection:"), 11) == 0)
+      {
+        const char *value = _line + 11;
+        while (*value == ' ')
+          value++;
+        if (strncasecmp_P(value, PSTR("close"), 5) == 0)
+          response.keepAlive = false;
+        else if (strncasecmp_P(value, PSTR("keep-alive"), 10) == 0)
+          response.keepAlive = true;
+      }
+      return true;
+    }
+
+    // end of the headers
+    if (response.status >= 100 && response.status < 200)
+      _state = StatusLine; // 100 Continue, the real response follows
+    else if ((_headMask & 1) || response.status == 204 || response.status == 304)
+      _state = Complete;
+    else if (response.chunked)
+      _state = ChunkSize;
+    else if (response.contentLength >= 0)
+    {
+      _remaining = response.contentLength;
+      _state = (_remaining > 0) ? Body : Complete;
+    }
+    else
+    {
+      response.keepAlive = false; // the body ends when the connection closes
+      _state = UntilClose;
+    }
+    return true;
+
+  case ChunkSize:
+  {
+    const char *p = _line;
+    if (!isxdigit(*p))
+      return false;
+    _remaining = 0;
+    for (; isxdigit(*p); p++)
+      _remaining = (_remaining << 4) | (isdigit(*p) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+    _state = (_remaining > 0) ? ChunkData : Trailers;
+    return true;
+  }
+
+  case ChunkEnd:
+    if (_line[0] != 0)
+      return false;
+    _state = ChunkSize;
+    return true;
+
+  case Trailers:
+    if (_line[0] == 0)
+      _state = Complete;
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+uint16_t HTTPSession::measureRequest()
+{
+  return _sending->_requestLength;
+}
+
+void HTTPSession::streamRequest(Stream &stream)
+{
+  _sending->writeRequest(stream);
+  if (_sending->_ptrStreamBody)
+    _sending->_ptrStreamBody(stream);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "TinySIM800.h"
+
+#ifndef HTTP_RX_BUFFER_SIZE
+#define HTTP_RX_BUFFER_SIZE 128 // bytes per AT+CIPRXGET, at most 254
+#endif
+#ifndef HTTP_LINE_SIZE
+#define HTTP_LINE_SIZE 64
+#endif
+#ifndef HTTP_MAX_PIPELINE
+#define HTTP_MAX_PIPELINE 4
+#endif
+#define HTTP_MAX_SEND 1460 // bytes per AT+CIPSEND
+
+struct HTTPResponse
+{
+        uint16_t status;
+        int32_t contentLength; // -1 when not given
+        bool chunked;
+        bool keepAlive;
+        uint32_t received; // body bytes
+};
+
+// HTTP/1.1 client on top of the TinySIM800 TCP socket, as an alternative to
+// the modem's own HTTP stack (postHTTP), which sets up a new connection for
+// every request and has to wait for +HTTPACTION. The connection is kept
+// open, and requests can be sent one after the other without waiting for
+// their responses (up to HTTP_MAX_PIPELINE); responses are then read in
+// order, with the body (plain or chunked) streamed into a DownloadSink:
+//
+//   session.connect(host);
+//   session.request("POST", "/v1/points", NULL, measureBody, streamBody);
+//   session.request("POST", "/v1/points", NULL, measureBody, streamBody);
+//   HTTPResponse response;
+//   while (session.outstanding() > 0 && session.response(response))
+//     ...
+//
+// Each request (headers and body) goes out in one AT+CIPSEND, so it must be
+// at most HTTP_MAX_SEND bytes. When the server closes the connection, or a
+// response can't be read, the session closes and requests still waiting for
+// their response have to be sent again after connect().
+class HTTPSession
+{
+public:
+        HTTPSession(TinySIM800 &modem);
+
+        bool connect(char *host, uint16_t port = 80);
+        void close();
+        bool connected() const { return _connected; }
+
+        // headers: extra header lines, each ending in "\r\n"
+        bool request(const char *method, const char *path, const char *headers = NULL,
+                     uint16_t (*ptrMeasureBody)() = NULL,
+                     void (*ptrStreamBody)(Stream &) = NULL);
+        bool response(HTTPResponse &response, DownloadSink *sink = NULL, uint16_t timeout = 10000);
+
+        // requests sent, waiting for their response
+        uint8_t outstanding() const { return _outstanding; }
+
+protected:
+        TinySIM800 &_modem;
+
+        char *_host;
+        bool _connected;
+
+        uint8_t _outstanding;
+        uint8_t _headMask; // bit n: the nth outstanding request is a HEAD
+
+        // request being sent
+        const char *_method;
+        const char *_path;
+        const char *_headers;
+        uint16_t _bodyLength;
+        void (*_ptrStreamBody)(Stream &);
+        uint16_t _requestLength;
+
+        // response being read
+        uint8_t _state;
+        uint32_t _remaining;
+        char _line[HTTP_LINE_SIZE];
+        uint8_t _lineLen;
+
+        uint8_t _rx[HTTP_RX_BUFFER_SIZE];
+        uint8_t _rxLen;
+        uint8_t _rxPos;
+        uint16_t _avail; // still in the modem, as of the last AT+CIPRXGET
+
+        void writeRequest(Print &out);
+        bool parse(HTTPResponse &response, DownloadSink *sink);
+        bool parseLine(HTTPResponse &response);
+
+        // TCPsend takes plain function pointers
+        static HTTPSession *_sending;
+        static uint16_t measureRequest();
+        static void streamRequest(Stream &stream);
+};
@@ -0,0 +1,99 @@
+#include <Arduino.h>
+
+#include "LinkSampler.h"
+
+LinkSampler::LinkSampler(TinySIM800 &modem, uint32_t interval, bool cellInfo)
+    : _modem(modem), _interval(interval), _cellInfo(cellInfo)
+{
+  _minRssi = 10; // about -93 dBm
+  _maxBer = 4;
+  _next = 0;
+  _count = 0;
+  _lastAttempt = 0;
+  _attempted = false;
+}
+
+void LinkSampler::setThresholds(uint8_t minRssi, uint8_t maxBer)
+{
+  _minRssi = minRssi;
+  _maxBer = maxBer;
+}
+
+bool LinkSampler::sample()
+{
+  LinkSample s;
+
+  if (!_modem.getSignalQuality(&s.rssi, &s.ber))
+    return false;
+
+  s.rxl = 0;
+  s.rxq = 0;
+  s.cellId = 0;
+  if (_cellInfo)
+  {
+    ServingCell cell;
+    if (_modem.getServingCell(&cell))
+    {
+      s.rxl = cell.rxl;
+      s.rxq = cell.rxq;
+      s.cellId = cell.cellId;
+    }
+  }
+
+  s.time = millis();
+
+  _samples[_next] = s;
+  _next = (_next + 1) % LINK_SAMPLER_WINDOW;
+  if (_count < LINK_SAMPLER_WINDOW)
+    _count++;
+
+  return true;
+}
+
+// A failed sample waits for the next interval as well, or a modem that
+// doesn't answer would be asked again on every loop.
+void LinkSampler::loop()
+{
+  if (_attempted && millis() - _lastAttempt < _interval)
+    return;
+
+  _attempted = true;
+  _lastAttempt = millis();
+  sample();
+}
+
+uint8_t LinkSampler::averageRssi() const
+{
+  uint16_t sum = 0;
+  uint8_t n = 0;
+
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    if (_samples[i].rssi == 99)
+      continue;
+    sum += _samples[i].rssi;
+    n++;
+  }
+
+  return n > 0 ? sum / n : 99;
+}
+
+// Registered, a recent sample with a signal above the threshold and an
+// acceptable error rate, and the signal not falling below the average of
+// the window.
+bool LinkSampler::goodTimeToSend()
+{
+  if (_count == 0 || !_modem.isRegistered())
+    return false;
+
+  const LinkSample &s = latest();
+
+  if (millis() - s.time > 2 * _interval)
+    return false;
+  if (s.rssi == 99 || s.rssi < _minRssi)
+    return false;
+  if (s.ber != 99 && s.ber > _maxBer)
+    return false;
+
+  return s.rssi + 2 >= averageRssi();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "TinySIM800.h"
+
+#ifndef LINK_SAMPLER_WINDOW
+#define LINK_SAMPLER_WINDOW 8
+#endif
+
+struct LinkSample
+{
+        uint32_t time; // millis()
+        uint8_t rssi;  // 0..31, 99 unknown
+        uint8_t ber;   // 0..7, 99 unknown
+        uint8_t rxl;   // from AT+CENG, 0 if not sampled
+        uint8_t rxq;
+        uint32_t cellId;
+};
+
+// Samples the link quality (CSQ and, optionally, the serving cell from
+// AT+CENG) at a low rate and keeps the last few samples, so transmissions
+// can be held back until coverage is good:
+//
+//   sampler.loop();
+//   if (sampler.goodTimeToSend())
+//     queue.upload(modem, url);
+class LinkSampler
+{
+public:
+        LinkSampler(TinySIM800 &modem, uint32_t interval = 60000, bool cellInfo = true);
+
+        void setInterval(uint32_t interval) { _interval = interval; }
+        void setThresholds(uint8_t minRssi, uint8_t maxBer = 4);
+
+        bool sample();
+        void loop();
+
+        bool goodTimeToSend();
+
+        uint8_t count() const { return _count; }
+        const LinkSample &latest() const { return _samples[(_next + LINK_SAMPLER_WINDOW - 1) % LINK_SAMPLER_WINDOW]; }
+        uint8_t averageRssi() const;
+
+protected:
+        TinySIM800 &_modem;
+        uint32_t _interval;
+        bool _cellInfo;
+
+        uint8_t _minRssi;
+        uint8_t _maxBer;
+
+        LinkSample _samples[LINK_SAMPLER_WINDOW];
+        uint8_t _next;
+        uint8_t _count;
+
+        // last sample() from loop(), successful or not
+        uint32_t _lastAttempt;
+        bool _attempted;
+};
@@ -0,0 +1,461 @@
+#include <Arduino.h>
+
+#include "MQTTClient.h"
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x82
+#define MQTT_SUBACK 0x90
+#define MQTT_UNSUBSCRIBE 0xA2
+#define MQTT_UNSUBACK 0xB0
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+#define MQTT_DISCONNECT 0xE0
+
+MQTTClient::MQTTClient(TinySIM800 &modem)
+    : _modem(modem)
+{
+  _connected = false;
+  _keepAlive = 60;
+  _lastSent = 0;
+  _pingSent = 0;
+  _nextPacketId = 1;
+  _txLen = 0;
+  _rxLen = 0;
+  _rxSkip = 0;
+  _inflightCount = 0;
+  _storeLen = 0;
+  _resent = 0;
+  _ptrMessage = NULL;
+}
+
+bool MQTTClient::connect(char *server, uint16_t port, const char *clientId,
+                         const char *username, const char *password,
+                         uint16_t keepAlive)
+{
+  _connected = false;
+  _txLen = 0;
+  _rxLen = 0;
+  _rxSkip = 0;
+  _pingSent = 0;
+  _keepAlive = keepAlive;
+
+  if (!_modem.TCPconnect(server, port))
+    return false;
+
+  uint16_t remaining = 10 + 2 + strlen(clientId);
+  uint8_t flags = 0x02; // clean session
+  if (username)
+  {
+    remaining += 2 + strlen(username);
+    flags |= 0x80;
+  }
+  if (password)
+  {
+    remaining += 2 + strlen(password);
+    flags |= 0x40;
+  }
+
+  if (!beginPacket(MQTT_CONNECT, remaining))
+    return false;
+  putString("MQTT");
+  put(4); // protocol level 3.1.1
+  put(flags);
+  put16(keepAlive);
+  putString(clientId);
+  if (username)
+    putString(username);
+  if (password)
+    putString(password);
+
+  if (!flush())
+    return false;
+
+  // wait for the CONNACK
+  uint32_t start = millis();
+  while (millis() - start < 10000)
+  {
+    if (_modem.TCPavailable() > 0)
+    {
+      uint8_t connack[4];
+      if (_modem.TCPread(connack, sizeof(connack)) != sizeof(connack))
+        return false;
+      if (connack[0] != MQTT_CONNACK || connack[3] != 0)
+        return false;
+
+      _connected = true;
+
+      // the clean session dropped whatever the broker had of them
+      for (uint8_t i = 0; i < _inflightCount; i++)
+        if (!resend(i))
+          return false;
+
+      return flush();
+    }
+    delay(100);
+  }
+
+  DEBUG_PRINTLN(F("MQTT: no CONNACK"));
+  return false;
+}
+
+void MQTTClient::disconnect()
+{
+  if (_connected && beginPacket(MQTT_DISCONNECT, 0))
+    flush();
+
+  _connected = false;
+  _modem.TCPclose();
+}
+
+bool MQTTClient::publish(const char *topic, const uint8_t *payload, uint16_t len, uint8_t qos, bool retain)
+{
+  if (!_connected || qos > 1)
+    return false;
+
+  uint16_t remaining = 2 + strlen(topic) + len + (qos > 0 ? 2 : 0);
+  uint16_t size = (remaining < 128 ? 2 : 3) + remaining;
+
+  // no room to keep a copy: let the caller retry once PUBACKs came in
+  if (qos > 0 && (_inflightCount >= MQTT_MAX_INFLIGHT || _storeLen + size > sizeof(_store)))
+    return false;
+
+  if (!beginPacket(MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0), remaining))
+    return false;
+  uint8_t start = _txLen - (size - remaining);
+
+  putString(topic);
+  uint16_t id = qos > 0 ? packetId() : 0;
+  if (qos > 0)
+    put16(id);
+  memcpy(_tx + _txLen, payload, len);
+  _txLen += len;
+
+  if (qos > 0)
+  {
+    memcpy(_store + _storeLen, _tx + start, size);
+    _storeLen += size;
+    _inflight[_inflightCount] = id;
+    _inflightSent[_inflightCount] = millis();
+    _inflightLen[_inflightCount] = size;
+    _inflightCount++;
+  }
+
+  return true;
+}
+
+bool MQTTClient::publish(const char *topic, const char *payload, uint8_t qos, bool retain)
+{
+  return publish(topic, (const uint8_t *)payload, strlen(payload), qos, retain);
+}
+
+bool MQTTClient::subscribe(const char *topic, uint8_t qos)
+{
+  if (!_connected || qos > 1)
+    return false;
+
+  if (!beginPacket(MQTT_SUBSCRIBE, 2 + 2 + strlen(topic) + 1))
+    return false;
+  put16(packetId());
+  putString(topic);
+  put(qos);
+
+  return flush();
+}
+
+bool MQTTClient::unsubscribe(const char *topic)
+{
+  if (!_connected)
+    return false;
+
+  if (!beginPacket(MQTT_UNSUBSCRIBE, 2 + 2 + strlen(topic)))
+    return false;
+  put16(packetId());
+  putString(topic);
+
+  return flush();
+}
+
+// Send everything collected in the transmit buffer in one go. When that
+// fails the connection is considered lost; QoS 1 publishes stay in flight
+// and go out again after the next connect().
+bool MQTTClient::flush()
+{
+  if (_txLen == 0)
+    return true;
+
+  bool sent = _modem.TCPsend((char *)_tx, _txLen);
+  _txLen = 0;
+
+  if (!sent)
+  {
+    _connected = false;
+    return false;
+  }
+
+  _lastSent = millis();
+  return true;
+}
+
+void MQTTClient::loop()
+{
+  if (!_connected)
+    return;
+
+  if (!flush())
+    return;
+
+  uint32_t now = millis();
+  uint32_t keepAlive = (uint32_t)_keepAlive * 1000;
+
+  if (_keepAlive > 0)
+  {
+    if (_pingSent != 0 && now - _pingSent > keepAlive)
+    {
+      // no PINGRESP within a keepalive period, the broker is gone
+      DEBUG_PRINTLN(F("MQTT: ping timeout"));
+      _connected = false;
+      return;
+    }
+
+    if (_pingSent == 0 && now - _lastSent >= keepAlive)
+    {
+      if (beginPacket(MQTT_PINGREQ, 0) && flush())
+        _pingSent = now;
+    }
+  }
+
+  receive();
+  resendExpired();
+}
+
+uint16_t MQTTClient::packetId()
+{
+  if (_nextPacketId == 0)
+    _nextPacketId = 1;
+  return _nextPacketId++;
+}
+
+// Start a packet in the transmit buffer, sending what is already in there
+// first if the new packet doesn't fit anymore.
+bool MQTTClient::beginPacket(uint8_t header, uint16_t remaining)
+{
+  uint8_t lengthBytes = remaining < 128 ? 1 : 2;
+
+  if (1 + lengthBytes + remaining > MQTT_TX_BUFFER_SIZE)
+    return false;
+
+  if (_txLen + 1 + lengthBytes + remaining > MQTT_TX_BUFFER_SIZE)
+    if (!flush())
+      return false;
+
+  put(header);
+  do
+  {
+    uint8_t b = remaining & 0x7F;
+    remaining >>= 7;
+    if (remaining > 0)
+      b |= 0x80;
+    put(b);
+  } while (remaining > 0);
+
+  return true;
+}
+
+void MQTTClient::put16(uint16_t v)
+{
+  put(v >> 8);
+  put(v & 0xFF);
+}
+
+void MQTTClient::putString(const char *s)
+{
+  uint16_t len = strlen(s);
+
+  put16(len);
+  memcpy(_tx + _txLen, s, len);
+  _txLen += len;
+}
+
+// Read what the modem has buffered for us and handle every complete packet.
+bool MQTTClient::receive()
+{
+  uint16_t avail = _modem.TCPavailable();
+
+  while (avail > 0)
+  {
+    uint8_t space = sizeof(_rx) - _rxLen;
+    uint8_t len = _modem.TCPread(_rx + _rxLen, avail < space ? avail : space);
+    if (len == 0)
+      return false;
+    avail -= len;
+    _rxLen += len;
+
+    uint8_t pos = 0;
+    while (pos < _rxLen)
+    {
+      if (_rxSkip > 0)
+      {
+        uint8_t n = (uint32_t)(_rxLen - pos) < _rxSkip ? _rxLen - pos : _rxSkip;
+        pos += n;
+        _rxSkip -= n;
+        continue;
+      }
+
+      // fixed header: type and a remaining length of up to 4 bytes
+      uint32_t remaining = 0;
+      uint8_t headerLen = 1;
+      bool complete = false;
+      while (pos + headerLen < _rxLen && headerLen <= 4)
+      {
+        uint8_t b = _rx[pos + headerLen];
+        remaining |= (uint32_t)(b & 0x7F) << (7 * (headerLen - 1));
+        headerLen++;
+        if ((b & 0x80) == 0)
+        {
+          complete = true;
+          break;
+        }
+      }
+      if (!complete && headerLen > 4)
+      {
+        // a fifth length byte: not MQTT, and no way to find the next packet
+        DEBUG_PRINTLN(F("MQTT: malformed remaining length"));
+        _rxLen = 0;
+        _connected = false;
+        _modem.TCPclose();
+        return false;
+      }
+      if (!complete)
+        break;
+
+      if (headerLen + remaining > sizeof(_rx))
+      {
+        DEBUG_PRINTLN(F("MQTT: packet too large, skipped"));
+        _rxSkip = headerLen + remaining;
+        continue;
+      }
+      if (pos + headerLen + remaining > _rxLen)
+        break;
+
+      handlePacket(_rx + pos, headerLen, remaining);
+      pos += headerLen + remaining;
+    }
+
+    memmove(_rx, _rx + pos, _rxLen - pos);
+    _rxLen -= pos;
+  }
+
+  return true;
+}
+
+bool MQTTClient::handlePacket(uint8_t *packet, uint8_t headerLen, uint16_t remaining)
+{
+  uint8_t *p = packet + headerLen;
+
+  switch (packet[0] & 0xF0)
+  {
+  case MQTT_PUBLISH:
+  {
+    uint8_t qos = (packet[0] >> 1) & 0x03;
+    if (remaining < 2 || qos == 3)
+      return false;
+    uint16_t topicLen = (p[0] << 8) | p[1];
+    uint16_t offset = 2 + topicLen + (qos > 0 ? 2 : 0);
+    if (offset > remaining)
+      return false;
+
+    if (qos == 1)
+    {
+      uint16_t id = (p[2 + topicLen] << 8) | p[3 + topicLen];
+      if (beginPacket(MQTT_PUBACK, 2))
+        put16(id);
+    }
+
+    // move the topic over its length field to make room for a terminator
+    memmove(p, p + 2, topicLen);
+    p[topicLen] = 0;
+
+    if (_ptrMessage)
+      _ptrMessage((const char *)p, packet + headerLen + offset, remaining - offset);
+    return true;
+  }
+  case MQTT_PUBACK:
+    if (remaining < 2)
+      return false;
+    acknowledge((p[0] << 8) | p[1]);
+    return true;
+  case MQTT_PINGRESP:
+    _pingSent = 0;
+    return true;
+  case MQTT_SUBACK:
+    if (remaining >= 3 && p[2] == 0x80)
+      DEBUG_PRINTLN(F("MQTT: subscription refused"));
+    return true;
+  case MQTT_UNSUBACK:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void MQTTClient::acknowledge(uint16_t id)
+{
+  uint16_t offset = 0;
+
+  for (uint8_t i = 0; i < _inflightCount; i++)
+  {
+    if (_inflight[i] == id)
+    {
+      uint8_t len = _inflightLen[i];
+      memmove(_store + offset, _store + offset + len, _storeLen - offset - len);
+      _storeLen -= len;
+
+      _inflightCount--;
+      for (; i < _inflightCount; i++)
+      {
+        _inflight[i] = _inflight[i + 1];
+        _inflightSent[i] = _inflightSent[i + 1];
+        _inflightLen[i] = _inflightLen[i + 1];
+      }
+      return;
+    }
+    offset += _inflightLen[i];
+  }
+}
+
+// Queue the kept copy of in-flight publish i again, marked as a duplicate.
+bool MQTTClient::resend(uint8_t i)
+{
+  uint16_t offset = 0;
+  for (uint8_t j = 0; j < i; j++)
+    offset += _inflightLen[j];
+
+  uint8_t len = _inflightLen[i];
+  if (_txLen + len > MQTT_TX_BUFFER_SIZE)
+    if (!flush())
+      return false;
+
+  _store[offset] |= 0x08; // DUP
+  memcpy(_tx + _txLen, _store + offset, len);
+  _txLen += len;
+
+  _inflightSent[i] = millis();
+  _resent++;
+  return true;
+}
+
+// Send QoS 1 publishes again that were not acknowledged within a keepalive
+// period (or 60 seconds when keepalive is off).
+void MQTTClient::resendExpired()
+{
+  uint32_t limit = _keepAlive > 0 ? (uint32_t)_keepAlive * 1000 : 60000;
+  uint32_t now = millis();
+
+  for (uint8_t i = 0; i < _inflightCount; i++)
+    if (now - _inflightSent[i] > limit)
+      if (!resend(i))
+        return;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "TinySIM800.h"
+
+#ifndef MQTT_TX_BUFFER_SIZE
+#define MQTT_TX_BUFFER_SIZE 128
+#endif
+#ifndef MQTT_RX_BUFFER_SIZE
+#define MQTT_RX_BUFFER_SIZE 128
+#endif
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 8
+#endif
+#if MQTT_TX_BUFFER_SIZE > 255 || MQTT_RX_BUFFER_SIZE > 255
+#error "MQTT_TX_BUFFER_SIZE and MQTT_RX_BUFFER_SIZE must be at most 255, positions in them are bytes"
+#endif
+// bytes kept for resending unacknowledged QoS 1 publishes, shared by all
+#ifndef MQTT_INFLIGHT_STORE_SIZE
+#define MQTT_INFLIGHT_STORE_SIZE 256
+#endif
+
+// MQTT 3.1.1 client on top of the TinySIM800 TCP socket. The connection is
+// kept open; publishes are collected in a transmit buffer and go out
+// together in one AT+CIPSEND when the buffer is full, on flush() or on
+// loop(). QoS 1 publishes don't wait for their PUBACK: a copy is kept until
+// it arrives in loop(), and sent again with DUP set when it doesn't come
+// within a keepalive period and after a reconnect, so they are delivered at
+// least once. Inbound subscriptions are delivered to the onMessage callback
+// (QoS 0 and 1).
+//
+// Call loop() often: it sends pending publishes, keeps the connection alive
+// and processes incoming packets.
+class MQTTClient
+{
+public:
+        MQTTClient(TinySIM800 &modem);
+
+        bool connect(char *server, uint16_t port, const char *clientId,
+                     const char *username = NULL, const char *password = NULL,
+                     uint16_t keepAlive = 60);
+        void disconnect();
+        bool connected() const { return _connected; }
+
+        bool publish(const char *topic, const uint8_t *payload, uint16_t len, uint8_t qos = 0, bool retain = false);
+        bool publish(const char *topic, const char *payload, uint8_t qos = 0, bool retain = false);
+        bool subscribe(const char *topic, uint8_t qos = 0);
+        bool unsubscribe(const char *topic);
+
+        bool flush();
+        void loop();
+
+        void onMessage(void (*ptrMessage)(const char *topic, const uint8_t *payload, uint16_t len)) { _ptrMessage = ptrMessage; }
+
+        // QoS 1 publishes waiting for their PUBACK, and how often one was sent again
+        uint8_t pending() const { return _inflightCount; }
+        uint16_t resent() const { return _resent; }
+
+protected:
+        TinySIM800 &_modem;
+
+        bool _connected;
+        uint16_t _keepAlive;
+        uint32_t _lastSent;
+        uint32_t _pingSent;
+        uint16_t _nextPacketId;
+
+        uint8_t _tx[MQTT_TX_BUFFER_SIZE];
+        uint8_t _txLen;
+
+        uint8_t _rx[MQTT_RX_BUFFER_SIZE];
+        uint8_t _rxLen;
+        uint32_t _rxSkip; // bytes left of a packet too large for _rx
+
+        // in publish order, their packets back to back in _store
+        uint16_t _inflight[MQTT_MAX_INFLIGHT];
+        uint32_t _inflightSent[MQTT_MAX_INFLIGHT];
+        uint8_t _inflightLen[MQTT_MAX_INFLIGHT];
+        uint8_t _inflightCount;
+        uint8_t _store[MQTT_INFLIGHT_STORE_SIZE];
+        uint16_t _storeLen;
+        uint16_t _resent;
+
+        void (*_ptrMessage)(const char *topic, const uint8_t *payload, uint16_t len);
+
+        uint16_t packetId();
+        bool beginPacket(uint8_t header, uint16_t remaining);
+        void put(uint8_t b) { _tx[_txLen++] = b; }
+        void put16(uint16_t v);
+        void putString(const char *s);
+
+        bool receive();
+        bool handlePacket(uint8_t *packet, uint8_t headerLen, uint16_t remaining);
+        void acknowledge(uint16_t id);
+        bool resend(uint8_t i);
+        void resendExpired();
+};
@@ -0,0 +1,137 @@
+#include "PacedStream.h"
+
+PacedStream::PacedStream(Stream &port)
+    : _port(port)
+{
+  _chunk = 0;
+  _pause = 0;
+  _cts = NULL;
+  _ctsTimeout = 1000;
+
+  _inChunk = 0;
+  _left = 0;
+  _failed = false;
+
+  _stalls = 0;
+  _stallTime = 0;
+}
+
+void PacedStream::configure(uint16_t chunk, uint16_t pause)
+{
+  _chunk = chunk;
+  _pause = pause;
+}
+
+void PacedStream::setCTS(bool (*cts)(), uint16_t ctsTimeout)
+{
+  _cts = cts;
+  _ctsTimeout = ctsTimeout;
+}
+
+void PacedStream::begin(uint32_t length)
+{
+  _inChunk = 0;
+  _left = length;
+  _failed = false;
+}
+
+// The bytes still missing from the announced length, as fill. CTS is
+// waited for once more, then they go regardless.
+void PacedStream::pad(uint8_t fill)
+{
+  uint32_t start = millis();
+
+  for (; _left > 0; _left--)
+  {
+    while (_cts != NULL && !_cts() && millis() - start <= _ctsTimeout)
+      delay(1);
+    _port.write(fill);
+  }
+}
+
+int PacedStream::available()
+{
+  return _port.available();
+}
+
+int PacedStream::read()
+{
+  return _port.read();
+}
+
+int PacedStream::peek()
+{
+  return _port.peek();
+}
+
+size_t PacedStream::write(uint8_t b)
+{
+  return write(&b, 1);
+}
+
+size_t PacedStream::write(const uint8_t *buffer, size_t size)
+{
+  if (_failed)
+    return 0;
+
+  if (_chunk == 0 && _cts == NULL)
+  {
+    size_t written = _port.write(buffer, size);
+    _left -= min((uint32_t)written, _left);
+    return written;
+  }
+
+  size_t written = 0;
+  while (written < size)
+  {
+    if (!waitForCTS())
+      break;
+
+    size_t n = size - written;
+    if (_chunk > 0 && n > (size_t)(_chunk - _inChunk))
+      n = _chunk - _inChunk;
+    if (_cts != NULL && n > 1)
+      n = 1; // so CTS is looked at before every byte
+
+    written += _port.write(buffer + written, n);
+    _inChunk += n;
+    _left -= min((uint32_t)n, _left);
+
+    if (_chunk > 0 && _inChunk >= _chunk)
+    {
+      _port.flush(); // let the UART drain before pausing
+      delay(_pause);
+      _inChunk = 0;
+    }
+  }
+
+  return written;
+}
+
+void PacedStream::flush()
+{
+  _port.flush();
+}
+
+bool PacedStream::waitForCTS()
+{
+  if (_cts == NULL || _cts())
+    return true;
+
+  _stalls++;
+
+  uint32_t start = millis();
+  while (!_cts())
+  {
+    if (millis() - start > _ctsTimeout)
+    {
+      _stallTime += millis() - start;
+      _failed = true;
+      return false;
+    }
+    delay(1);
+  }
+  _stallTime += millis() - start;
+
+  return true;
+}
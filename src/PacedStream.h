@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Sits between a body writer (ptrStreamBody, CborWriter, ...) and the modem
+// port, and keeps it from overrunning the modem's receive buffer at high
+// baud rates: bytes go out in chunks of at most chunk bytes, with pause ms
+// after each chunk. With a cts callback (for boards without hardware flow
+// control, see AT+IFC) writing is also held off while the modem deasserts
+// CTS, for at most ctsTimeout ms, after which the transfer is abandoned.
+// The modem still expects the rest of the announced length then; pad() sends
+// it, so the modem leaves data mode.
+//
+// A chunk of 0 passes everything straight through.
+class PacedStream : public Stream
+{
+public:
+        PacedStream(Stream &port);
+
+        void configure(uint16_t chunk, uint16_t pause = 0);
+        void setCTS(bool (*cts)(), uint16_t ctsTimeout = 1000);
+
+        // start of a body of length bytes
+        void begin(uint32_t length = 0);
+        bool failed() const { return _failed; }
+        void pad(uint8_t fill = ' ');
+
+        int available();
+        int read();
+        int peek();
+        size_t write(uint8_t b);
+        size_t write(const uint8_t *buffer, size_t size);
+        void flush();
+        using Print::write;
+
+        // times writing was held off by CTS, and for how long in total
+        uint16_t stalls() const { return _stalls; }
+        uint32_t stallTime() const { return _stallTime; }
+
+protected:
+        Stream &_port;
+
+        uint16_t _chunk;
+        uint16_t _pause;
+        bool (*_cts)();
+        uint16_t _ctsTimeout;
+
+        uint16_t _inChunk;
+        uint32_t _left;
+        bool _failed;
+
+        uint16_t _stalls;
+        uint32_t _stallTime;
+
+        bool waitForCTS();
+};
@@ -0,0 +1,116 @@
+#include "Sha256.h"
+
+static const uint32_t k[64] PROGMEM = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+void Sha256::reset()
+{
+  _state[0] = 0x6a09e667;
+  _state[1] = 0xbb67ae85;
+  _state[2] = 0x3c6ef372;
+  _state[3] = 0xa54ff53a;
+  _state[4] = 0x510e527f;
+  _state[5] = 0x9b05688c;
+  _state[6] = 0x1f83d9ab;
+  _state[7] = 0x5be0cd19;
+  _blockLen = 0;
+  _length = 0;
+}
+
+void Sha256::update(const uint8_t *data, uint16_t len)
+{
+  _length += len;
+
+  while (len--)
+  {
+    _block[_blockLen++] = *data++;
+    if (_blockLen == sizeof(_block))
+    {
+      transform();
+      _blockLen = 0;
+    }
+  }
+}
+
+void Sha256::finish(uint8_t hash[32])
+{
+  uint32_t bits = _length * 8;
+  uint32_t high = _length >> 29;
+
+  _block[_blockLen++] = 0x80;
+  if (_blockLen > 56)
+  {
+    memset(_block + _blockLen, 0, sizeof(_block) - _blockLen);
+    transform();
+    _blockLen = 0;
+  }
+  memset(_block + _blockLen, 0, 56 - _blockLen);
+
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    _block[56 + i] = high >> (24 - 8 * i);
+    _block[60 + i] = bits >> (24 - 8 * i);
+  }
+  transform();
+
+  for (uint8_t i = 0; i < 32; i++)
+    hash[i] = _state[i / 4] >> (24 - 8 * (i % 4));
+
+  reset();
+}
+
+// The message schedule is computed on the fly in a 16 word window, to keep
+// stack use down on small targets.
+void Sha256::transform()
+{
+  uint32_t w[16];
+  uint32_t a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+  uint32_t e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+
+  for (uint8_t i = 0; i < 16; i++)
+    w[i] = ((uint32_t)_block[4 * i] << 24) | ((uint32_t)_block[4 * i + 1] << 16) |
+           ((uint32_t)_block[4 * i + 2] << 8) | _block[4 * i + 3];
+
+  for (uint8_t i = 0; i < 64; i++)
+  {
+    if (i >= 16)
+    {
+      uint32_t w15 = w[(i - 15) & 15];
+      uint32_t w2 = w[(i - 2) & 15];
+      uint32_t s0 = ROTR(w15, 7) ^ ROTR(w15, 18) ^ (w15 >> 3);
+      uint32_t s1 = ROTR(w2, 17) ^ ROTR(w2, 19) ^ (w2 >> 10);
+      w[i & 15] += s0 + w[(i - 7) & 15] + s1;
+    }
+
+    uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) +
+                  pgm_read_dword(&k[i]) + w[i & 15];
+    uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  _state[0] += a;
+  _state[1] += b;
+  _state[2] += c;
+  _state[3] += d;
+  _state[4] += e;
+  _state[5] += f;
+  _state[6] += g;
+  _state[7] += h;
+}
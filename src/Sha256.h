@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Arduino.h>
+
+// SHA-256 (FIPS 180-4), computed incrementally.
+class Sha256
+{
+public:
+        Sha256() { reset(); }
+
+        void reset();
+        void update(const uint8_t *data, uint16_t len);
+        void finish(uint8_t hash[32]);
+
+private:
+        uint32_t _state[8];
+        uint8_t _block[64];
+        uint8_t _blockLen;
+        uint32_t _length; // bytes
+
+        void transform();
+};
@@ -0,0 +1,219 @@
+#include <Arduino.h>
+
+#include "TelemetryQueue.h"
+
+TelemetryQueue *TelemetryQueue::_uploading = NULL;
+TelemetryQueue *TelemetryQueue::_draining = NULL;
+uint8_t TelemetryQueue::_batchCount = 0;
+uint16_t TelemetryQueue::_statusCode = 0;
+
+TelemetryQueue::TelemetryQueue(char *buffer, uint8_t slots, uint8_t slotSize, QueueStorage *storage)
+    : _buffer(buffer), _slots(slots), _slotSize(slotSize), _storage(storage)
+{
+  _sampler = NULL;
+
+  _head = 0;
+  _count = 0;
+  _dropped = 0;
+
+  _maxBatch = 10;
+  _open = '[';
+  _separator = ',';
+  _close = ']';
+
+  _drainUrl = NULL;
+  _drainHeaders = NULL;
+}
+
+// Restore the queue from storage (if any). Call once at startup.
+bool TelemetryQueue::begin()
+{
+  _head = 0;
+  _count = 0;
+
+  if (_storage == NULL)
+    return true;
+
+  uint8_t state[2];
+  if (!_storage->read(0, state, sizeof(state)))
+    return false;
+
+  // erased or foreign content, start empty
+  if (state[0] >= _slots || state[1] > _slots)
+    return saveState();
+
+  for (uint8_t i = 0; i < _slots; i++)
+  {
+    if (!_storage->read(2 + (uint16_t)i * _slotSize, (uint8_t *)_buffer + (uint16_t)i * _slotSize, _slotSize))
+      return false;
+    _buffer[(uint16_t)i * _slotSize + _slotSize - 1] = 0;
+  }
+
+  _head = state[0];
+  _count = state[1];
+
+  return true;
+}
+
+bool TelemetryQueue::push(const char *payload)
+{
+  uint8_t len = strnlen(payload, _slotSize);
+  if (len >= _slotSize)
+    return false; // does not fit in a slot
+
+  if (_count == _slots)
+  {
+    // full, make room by dropping the oldest
+    _head = (_head + 1) % _slots;
+    _count--;
+    _dropped++;
+  }
+
+  memcpy(slot(_count), payload, len + 1);
+  _count++;
+
+  if (_storage)
+    return saveSlot(_count - 1) && saveState();
+
+  return true;
+}
+
+void TelemetryQueue::clear()
+{
+  _head = 0;
+  _count = 0;
+
+  if (_storage)
+    saveState();
+}
+
+void TelemetryQueue::setBatch(uint8_t maxBatch, char open, char separator, char close)
+{
+  _maxBatch = maxBatch > 0 ? maxBatch : 1;
+  _open = open;
+  _separator = separator;
+  _close = close;
+}
+
+// Post the oldest payloads (up to the batch size) as a single body. They are
+// only removed from the queue when the server answered with a 2xx.
+bool TelemetryQueue::upload(TinySIM800 &modem, const char *url, const char *headers)
+{
+  if (_count == 0)
+    return true;
+
+  if (_sampler && !_sampler->goodTimeToSend())
+    return false;
+
+  _uploading = this;
+  _batchCount = min(_count, _maxBatch);
+  _statusCode = 0;
+
+  bool sent = modem.postHTTP(url, headers, measureBody, streamBody, statusCode);
+
+  _uploading = NULL;
+
+  if (!sent || _statusCode < 200 || _statusCode >= 300)
+    return false;
+
+  pop(_batchCount);
+
+  return true;
+}
+
+bool TelemetryQueue::uploadAll(TinySIM800 &modem, const char *url, const char *headers)
+{
+  while (_count > 0)
+    if (!upload(modem, url, headers))
+      return false;
+
+  return true;
+}
+
+void TelemetryQueue::drainOnConnect(const char *url, const char *headers)
+{
+  _drainUrl = url;
+  _drainHeaders = headers;
+  _draining = this;
+}
+
+void TelemetryQueue::onGPRSConnected(void *sender, EventArgs *e)
+{
+  if (_draining == NULL || _draining->_drainUrl == NULL)
+    return;
+
+  _draining->uploadAll(*(TinySIM800 *)sender, _draining->_drainUrl, _draining->_drainHeaders);
+}
+
+void TelemetryQueue::pop(uint8_t n)
+{
+  if (n > _count)
+    n = _count;
+
+  _head = (_head + n) % _slots;
+  _count -= n;
+
+  if (_storage)
+    saveState();
+}
+
+bool TelemetryQueue::saveState()
+{
+  uint8_t state[2] = {_head, _count};
+
+  return _storage->write(0, state, sizeof(state));
+}
+
+bool TelemetryQueue::saveSlot(uint8_t i)
+{
+  uint8_t index = (_head + i) % _slots;
+
+  return _storage->write(2 + (uint16_t)index * _slotSize, (uint8_t *)slot(i), _slotSize);
+}
+
+uint16_t TelemetryQueue::measureBatch(uint8_t n) const
+{
+  uint16_t len = 0;
+
+  if (_open)
+    len++;
+  for (uint8_t i = 0; i < n; i++)
+  {
+    if (i > 0 && _separator)
+      len++;
+    len += strlen(slot(i));
+  }
+  if (_close)
+    len++;
+
+  return len;
+}
+
+void TelemetryQueue::streamBatch(Stream &stream, uint8_t n) const
+{
+  if (_open)
+    stream.print(_open);
+  for (uint8_t i = 0; i < n; i++)
+  {
+    if (i > 0 && _separator)
+      stream.print(_separator);
+    stream.print(slot(i));
+  }
+  if (_close)
+    stream.print(_close);
+}
+
+uint16_t TelemetryQueue::measureBody()
+{
+  return _uploading->measureBatch(_batchCount);
+}
+
+void TelemetryQueue::streamBody(Stream &stream)
+{
+  _uploading->streamBatch(stream, _batchCount);
+}
+
+void TelemetryQueue::statusCode(const uint16_t code)
+{
+  _statusCode = code;
+}
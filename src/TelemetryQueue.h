@@ -0,0 +1,88 @@
+#pragma once
+
+#include "TinySIM800.h"
+#include "LinkSampler.h"
+
+// Persistent backing for a TelemetryQueue (EEPROM, a flash page, a file on
+// an SD card, ...). Addresses are relative to the start of the queue's area.
+class QueueStorage
+{
+public:
+        virtual bool read(uint16_t address, uint8_t *data, uint16_t len) = 0;
+        virtual bool write(uint16_t address, const uint8_t *data, uint16_t len) = 0;
+};
+
+// Bounded store-and-forward queue of text payloads (e.g. JSON readings).
+// Payloads are kept in a RAM ring of fixed size slots, optionally mirrored
+// to a QueueStorage so they survive a reset, and uploaded as one batched
+// POST body through TinySIM800::postHTTP. When the queue is full the oldest
+// payload is dropped.
+//
+// The storage needs 2 + slots * slotSize bytes.
+class TelemetryQueue
+{
+public:
+        TelemetryQueue(char *buffer, uint8_t slots, uint8_t slotSize, QueueStorage *storage = NULL);
+
+        bool begin();
+        bool push(const char *payload);
+        void clear();
+
+        uint8_t count() const { return _count; }
+        uint16_t dropped() const { return _dropped; }
+
+        // A batch of n payloads is sent as open + p1 + separator + ... + pn + close.
+        // Use 0 to leave out open, separator or close.
+        void setBatch(uint8_t maxBatch, char open = '[', char separator = ',', char close = ']');
+
+        // With a LinkSampler set, uploads are held back (upload returns false)
+        // while it doesn't consider it a good time to send.
+        void setLinkSampler(LinkSampler *sampler) { _sampler = sampler; }
+
+        bool upload(TinySIM800 &modem, const char *url, const char *headers = NULL);
+        bool uploadAll(TinySIM800 &modem, const char *url, const char *headers = NULL);
+
+        // Drain the queue into url as soon as GPRS comes up:
+        //   queue.drainOnConnect(url);
+        //   modem.gprsConnected += TelemetryQueue::onGPRSConnected;
+        void drainOnConnect(const char *url, const char *headers = NULL);
+        static void onGPRSConnected(void *sender, EventArgs *e);
+
+protected:
+        char *_buffer;
+        uint8_t _slots;
+        uint8_t _slotSize;
+        QueueStorage *_storage;
+        LinkSampler *_sampler;
+
+        uint8_t _head;
+        uint8_t _count;
+        uint16_t _dropped;
+
+        uint8_t _maxBatch;
+        char _open;
+        char _separator;
+        char _close;
+
+        const char *_drainUrl;
+        const char *_drainHeaders;
+
+        char *slot(uint8_t i) const { return _buffer + (uint16_t)((_head + i) % _slots) * _slotSize; }
+        void pop(uint8_t n);
+        bool saveState();
+        bool saveSlot(uint8_t i);
+
+        uint16_t measureBatch(uint8_t n) const;
+        void streamBatch(Stream &stream, uint8_t n) const;
+
+        // postHTTP takes plain function pointers, so the batch being uploaded is
+        // handed to them through these.
+        static TelemetryQueue *_uploading;
+        static TelemetryQueue *_draining;
+        static uint8_t _batchCount;
+        static uint16_t _statusCode;
+
+        static uint16_t measureBody();
+        static void streamBody(Stream &stream);
+        static void statusCode(const uint16_t code);
+};
@@ -20,15 +20,90 @@
 
 #include <Arduino.h>
 
-#include "TinySim800.h"
+#include "TinySIM800.h"
+
+// The command and reply strings, one PROGMEM string each (see Commands.h),
+// and tables of them by number. Replies carry their length, so a reply
+// that doesn't match is mostly rejected without reading flash.
+#define SIM800_TEXT(id, text) static const char id##_text[] PROGMEM = text;
+SIM800_COMMANDS(SIM800_TEXT)
+SIM800_REPLIES(SIM800_TEXT)
+#undef SIM800_TEXT
+
+#define SIM800_COMMAND(id, text) id##_text,
+static const char *const commandTable[] PROGMEM = {SIM800_COMMANDS(SIM800_COMMAND)};
+#undef SIM800_COMMAND
+
+struct ReplyEntry
+{
+  const char *text;
+  uint8_t len;
+};
+
+#define SIM800_REPLY(id, text) {id##_text, sizeof(text) - 1},
+static const ReplyEntry replyTable[] PROGMEM = {SIM800_REPLIES(SIM800_REPLY)};
+#undef SIM800_REPLY
+
+static const __FlashStringHelper *commandText(ATCommand command)
+{
+  return (const __FlashStringHelper *)pgm_read_ptr(&commandTable[command]);
+}
+
+static const __FlashStringHelper *replyText(ATReply reply)
+{
+  return (const __FlashStringHelper *)pgm_read_ptr(&replyTable[reply].text);
+}
+
+static uint8_t replyLength(ATReply reply)
+{
+  return pgm_read_byte(&replyTable[reply].len);
+}
 
 TinySIM800::TinySIM800(Stream &port)
-    : mySerial(port)
+    : _paced(port), mySerial(port)
 {
   apn = 0;
   apnusername = 0;
   apnpassword = 0;
-  ok_reply = F("OK");
+
+  _allowRoaming = false;
+  _engineeringMode = false;
+  _tcpConfigured = false;
+  _tcpOpen = false;
+  _dns = NULL;
+  _regStatus = 0;
+  _gprsRegStatus = 0;
+  _reportedRegistered = false;
+  _lac = 0;
+  _cellId = 0;
+
+  _adaptive = NULL;
+
+  _retryPolicy.attempts = 1;
+  _retryPolicy.backoff = 1000;
+  _retryPolicy.maxBackoff = 16000;
+  _retryPolicy.breakerThreshold = 0;
+  _retryPolicy.breakerCooldown = 60000;
+  _retries = 0;
+  _failures = 0;
+  _breakerTrips = 0;
+  _breakerOpen = false;
+  _breakerOpenedAt = 0;
+
+  _timeValid = false;
+  _timeZone = 0;
+  _epoch = 0;
+  _epochMillis = 0;
+  _lastSyncAttempt = 0;
+  _syncAttempted = false;
+
+  memset(&_gnssFix, 0, sizeof(_gnssFix));
+  _gnssFixPending = false;
+
+  _cts = NULL;
+  _rts = NULL;
+
+  _replyLen = 0;
 }
 
 bool TinySIM800::reset()
@@ -42,45 +117,63 @@ bool TinySIM800::init()
 {
   DEBUG_PRINTLN(F("Attempting to open comm with ATs"));
   // give 7 seconds to reboot
-  int16_t timeout = 7000;
+  uint32_t start = millis();
+  bool answered = false;
 
-  while (timeout > 0)
+  while (!answered && millis() - start < 7000)
   {
     while (mySerial.available())
       mySerial.read();
-    if (sendCheckReply(F("AT"), ok_reply))
-      break;
-    while (mySerial.available())
-      mySerial.read();
-    if (sendCheckReply(F("AT"), F("AT")))
-      break;
-    delay(500);
-    timeout -= 500;
+    if (sendCheckReply(CMD_AT, REPLY_OK))
+      answered = true;
+    else
+    {
+      while (mySerial.available())
+        mySerial.read();
+      if (sendCheckReply(CMD_AT, REPLY_AT))
+        answered = true;
+      else
+        delay(500);
+    }
   }
 
-  if (timeout <= 0)
+  if (!answered)
   {
     DEBUG_PRINTLN(F("Timeout: No response to AT... last ditch attempt."));
 
-    sendCheckReply(F("AT"), ok_reply);
+    sendCheckReply(CMD_AT, REPLY_OK);
     delay(100);
-    sendCheckReply(F("AT"), ok_reply);
+    sendCheckReply(CMD_AT, REPLY_OK);
     delay(100);
-    sendCheckReply(F("AT"), ok_reply);
+    sendCheckReply(CMD_AT, REPLY_OK);
     delay(100);
   }
 
   // turn off Echo!
-  sendCheckReply(F("ATE0"), ok_reply);
+  sendCheckReply(CMD_ATE0, REPLY_OK);
   delay(100);
 
-  if (!sendCheckReply(F("ATE0"), ok_reply))
+  if (!sendCheckReply(CMD_ATE0, REPLY_OK))
   {
     return false;
   }
 
+  // whatever TCP state the modem had, it is not ours anymore, and a reset
+  // left engineering mode
+  _tcpConfigured = false;
+  _tcpOpen = false;
+  _engineeringMode = false;
+
   // turn on hangupitude
-  sendCheckReply(F("AT+CVHU=0"), ok_reply);
+  sendCheckReply(CMD_CVHU, 0, REPLY_OK);
+
+  // report registration changes (with location) as URCs, so we don't
+  // have to poll for them
+  sendCheckReply(CMD_CREG, 2, REPLY_OK);
+  sendCheckReply(CMD_CGREG, 2, REPLY_OK);
+
+  refreshRegistration(false);
+  refreshRegistration(true);
 
   delay(100);
   flushInput();
@@ -94,32 +187,50 @@ void TinySIM800::allowRoaming(bool value)
 
 bool TinySIM800::setBaudrate(uint32_t baud)
 {
-  return sendCheckReply(F("AT+IPREX="), baud, ok_reply);
+  return sendCheckReply(CMD_IPREX, baud, REPLY_OK);
+}
+
+bool TinySIM800::setFlowControl(bool rtscts)
+{
+  return sendCheckReply(CMD_IFC, rtscts ? 2 : 0, rtscts ? 2 : 0, REPLY_OK);
+}
+
+void TinySIM800::setFlowControlPins(bool (*cts)(), void (*rts)(bool))
+{
+  _cts = cts;
+  _rts = rts;
+
+  _paced.setCTS(cts);
+}
+
+void TinySIM800::setBodyPacing(uint16_t chunk, uint16_t pause)
+{
+  _paced.configure(chunk, pause);
 }
 
 /* returns value in mV (uint16_t) */
 bool TinySIM800::getBattVoltage(uint16_t *v)
 {
-  return sendParseReply(F("AT+CBC"), F("+CBC: "), v, ',', 2);
+  return sendParseReply(CMD_CBC, REPLY_CBC, v, ',', 2);
 }
 
 char *TinySIM800::getIMEI()
 {
-  getReply(F("AT+GSN"));
+  getReply(CMD_GSN);
 
   return replybuffer;
 }
 
 char *TinySIM800::getVersion()
 {
-  getReply(F("ATI"));
+  getReply(CMD_ATI);
 
   return replybuffer;
 }
 
 char *TinySIM800::getFirmware()
 {
-  getReply(F("AT+GMR"));
+  getReply(CMD_GMR);
 
   return replybuffer;
 }
@@ -130,44 +241,255 @@ char *TinySIM800::getFirmware()
 // DTR-pin can then be released again.
 bool TinySIM800::sleepEnable(bool enable = true)
 {
-    return sendCheckReply(F("AT+CSCLK="), enable, ok_reply);
+    return sendCheckReply(CMD_CSCLK, enable, REPLY_OK);
 }
 
 /********* NETWORK *******************************************************/
 
+// Reads and handles whatever the modem has sent on its own accord
+// (registration changes, network time, ...). Nothing is sent to the modem.
+// The registration and GNSS events are fired from here rather than from
+// readline, so their handlers can send commands of their own.
+void TinySIM800::poll()
+{
+  while (inputAvailable())
+    readline(10);
+
+  if (_gnssFixPending)
+  {
+    // a copy, a URC read by the handler's own commands may replace _gnssFix
+    GNSSFix fix = _gnssFix;
+    _gnssFixPending = false;
+    gnssFix(this, &fix);
+  }
+
+  bool registered = isRegisteredStatus(_regStatus);
+  if (registered != _reportedRegistered)
+  {
+    _reportedRegistered = registered;
+    if (registered)
+      networkRegistered(this, NULL);
+    else
+      networkLost(this, NULL);
+  }
+}
+
+// Registration state is kept up to date by the +CREG URCs, enabled in init().
 bool TinySIM800::isRegistered()
 {
-  uint16_t status;
+  poll();
 
-  if (!sendParseReply(F("AT+CREG?"), F("+CREG: "), &status, ',', 1))
-    return 0;
+  return isRegisteredStatus(_regStatus);
+}
+
+bool TinySIM800::isGPRSRegistered()
+{
+  poll();
+
+  return isRegisteredStatus(_gprsRegStatus);
+}
+
+uint8_t TinySIM800::getRegistrationStatus()
+{
+  poll();
+
+  return _regStatus;
+}
+
+uint16_t TinySIM800::getLAC()
+{
+  poll();
+
+  return _lac;
+}
+
+uint32_t TinySIM800::getCellId()
+{
+  poll();
+
+  return _cellId;
+}
 
+bool TinySIM800::isRegisteredStatus(uint8_t status)
+{
   if (_allowRoaming)
     return (status == 1 || status == 5);
   else
     return (status == 1);
 }
 
+// Query the registration state once, to seed the cache. After that the URCs
+// keep it current.
+bool TinySIM800::refreshRegistration(bool gprs)
+{
+  if (gprs)
+    getReply(CMD_CGREG_READ);
+  else
+    getReply(CMD_CREG_READ);
+
+  if (!parseRegistration(gprs, true))
+    return false;
+
+  readline(); // eat 'OK'
+
+  return true;
+}
+
+// Parse a +CREG: or +CGREG: line in replybuffer into the registration cache.
+// The reply to the query carries the URC mode first (<n>,<stat>[,<lac>,<ci>]),
+// the URC itself starts with the status (<stat>[,<lac>,<ci>]). Returns false
+// if the line is not of the expected form.
+bool TinySIM800::parseRegistration(bool gprs, bool solicited)
+{
+  char *p = strchr(replybuffer, ':');
+  if (p == 0)
+    return false;
+  p++;
+  while (*p == ' ')
+    p++;
+
+  char *next = strchr(p, ',');
+  if (solicited)
+  {
+    if (next == 0)
+      return false;
+    p = next + 1;
+    next = strchr(p, ',');
+  }
+  else if (next != 0 && next[1] != '"')
+    return false; // a reply to AT+CREG?, not a URC
+
+  uint8_t status = atoi(p);
+  uint16_t lac = 0;
+  uint32_t cellId = 0;
+
+  if (next != 0)
+  {
+    p = strchr(next, '"');
+    if (p != 0)
+    {
+      lac = strtoul(p + 1, NULL, 16);
+      p = strchr(p + 1, ',');
+      if (p != 0 && p[1] == '"')
+        cellId = strtoul(p + 2, NULL, 16);
+    }
+  }
+
+  updateRegistration(gprs, status, lac, cellId);
+
+  return true;
+}
+
+void TinySIM800::updateRegistration(bool gprs, uint8_t status, uint16_t lac, uint32_t cellId)
+{
+  if (gprs)
+  {
+    _gprsRegStatus = status;
+    return;
+  }
+
+  // the events follow in poll()
+  _regStatus = status;
+  if (lac != 0 || cellId != 0)
+  {
+    _lac = lac;
+    _cellId = cellId;
+  }
+}
+
 uint8_t TinySIM800::getRSSI()
 {
   uint16_t reply;
 
-  if (!sendParseReply(F("AT+CSQ"), F("+CSQ: "), &reply))
+  if (!sendParseReply(CMD_CSQ, REPLY_CSQ, &reply))
     return 0;
 
   return reply;
 }
 
+/* rssi 0..31 (99 unknown), ber 0..7 (99 unknown) */
+bool TinySIM800::getSignalQuality(uint8_t *rssi, uint8_t *ber)
+{
+  uint16_t v;
+
+  getReply(CMD_CSQ);
+
+  if (!parseReply(replyText(REPLY_CSQ), &v, ',', 0))
+    return false;
+  *rssi = v;
+  if (!parseReply(replyText(REPLY_CSQ), &v, ',', 1))
+    return false;
+  *ber = v;
+
+  readline(); // eat 'OK'
+
+  return true;
+}
+
+bool TinySIM800::getServingCell(ServingCell *cell)
+{
+  // engineering mode, cell info without neighbour cell id's
+  if (!_engineeringMode)
+  {
+    if (!sendCheckReply(CMD_CENG, 1, 0, REPLY_OK))
+      return false;
+    _engineeringMode = true;
+  }
+
+  // +CENG: 1,0
+  // +CENG: 0,"<arfcn>,<rxl>,<rxq>,<mcc>,<mnc>,<bsic>,<cellid>,<rla>,<txp>,<lac>,<TA>"
+  // +CENG: 1,"..." (neighbours)
+  // OK
+  getReply(CMD_CENG_READ);
+  if (!isReplyPrefix(REPLY_CENG))
+    return false;
+  readline();
+
+  bool found = false;
+  if (isReplyPrefix(REPLY_CENG_SERVING))
+  {
+    char *p = replybuffer + replyLength(REPLY_CENG_SERVING);
+
+    char *field[11];
+    uint8_t n = 0;
+    field[n++] = p;
+    while (n < 11 && (p = strchr(p, ',')) != 0)
+      field[n++] = ++p;
+
+    if (n == 11)
+    {
+      cell->arfcn = atoi(field[0]);
+      cell->rxl = atoi(field[1]);
+      cell->rxq = atoi(field[2]);
+      cell->mcc = atoi(field[3]);
+      cell->mnc = atoi(field[4]);
+      cell->cellId = strtoul(field[6], NULL, 16);
+      cell->lac = strtoul(field[9], NULL, 16);
+      cell->ta = atoi(field[10]);
+      found = true;
+    }
+  }
+
+  // skip the neighbour cells
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    if (!readline() || isReply(REPLY_OK))
+      break;
+  }
+
+  return found;
+}
+
 bool TinySIM800::sendUSSD(char *ussdmsg, char *ussdbuff, uint16_t maxlen, uint16_t *readlen)
 {
-  if (!sendCheckReply(F("AT+CUSD=1"), ok_reply))
+  if (!sendCheckReply(CMD_CUSD, 1, REPLY_OK))
     return false;
 
   char sendcmd[30] = "AT+CUSD=1,\"";
   strncpy(sendcmd + 11, ussdmsg, 30 - 11 - 2); // 11 bytes beginning, 2 bytes for close quote + null
   sendcmd[strlen(sendcmd)] = '\"';
 
-  if (!sendCheckReply(sendcmd, ok_reply))
+  if (!sendCheckReply(sendcmd, REPLY_OK))
   {
     *readlen = 0;
     return false;
@@ -176,7 +498,7 @@ bool TinySIM800::sendUSSD(char *ussdmsg, char *ussdbuff, uint16_t maxlen, uint16
   {
     readline(10000); // read the +CUSD reply, wait up to 10 seconds!!!
     //DEBUG_PRINT("* "); DEBUG_PRINTLN(replybuffer);
-    char *p = prog_char_strstr(replybuffer, PSTR("+CUSD: "));
+    char *p = prog_char_strstr(replybuffer, (prog_char *)replyText(REPLY_CUSD));
     if (p == 0)
     {
       *readlen = 0;
@@ -191,11 +513,19 @@ bool TinySIM800::sendUSSD(char *ussdmsg, char *ussdbuff, uint16_t maxlen, uint16
       return false;
     }
     p += 1; //"
-    // Find " to get end of ussd message.
+    // Find " to get end of ussd message, the line may have been cut short.
     char *strend = strchr(p, '\"');
+    if (strend == 0)
+      strend = p + strlen(p);
+
+    if (maxlen == 0)
+    {
+      *readlen = 0;
+      return false;
+    }
 
-    uint16_t lentocopy = min(maxlen - 1, strend - p);
-    strncpy(ussdbuff, p, lentocopy + 1);
+    uint16_t lentocopy = min((uint16_t)(maxlen - 1), (uint16_t)(strend - p));
+    memcpy(ussdbuff, p, lentocopy);
     ussdbuff[lentocopy] = 0;
     *readlen = lentocopy;
   }
@@ -206,12 +536,12 @@ bool TinySIM800::enableNetworkTimeSync(bool onoff)
 {
   if (onoff)
   {
-    if (!sendCheckReply(F("AT+CLTS=1"), ok_reply))
+    if (!sendCheckReply(CMD_CLTS, 1, REPLY_OK))
       return false;
   }
   else
   {
-    if (!sendCheckReply(F("AT+CLTS=0"), ok_reply))
+    if (!sendCheckReply(CMD_CLTS, 0, REPLY_OK))
       return false;
   }
 
@@ -222,353 +552,1109 @@ bool TinySIM800::enableNetworkTimeSync(bool onoff)
 
 char *TinySIM800::getTime()
 {
-  getReply(F("AT+CCLK?"), (uint16_t)10000);
-  if (strncmp(replybuffer, "+CCLK: ", 7) != 0)
+  getReply(CMD_CCLK_READ, (uint16_t)10000);
+  if (!isReplyPrefix(REPLY_CCLK))
+    return NULL;
+
+  parseClock();
+
+  // +CCLK: "yy/MM/dd,hh:mm:ss+zz", strip the time zone and closing quote
+  uint8_t len = strlen(replybuffer);
+  if (len < replyLength(REPLY_CCLK) + 1 + 4)
     return NULL;
 
-  char *p = replybuffer + strlen("+CCLK: \"");
-  p[strlen(p) - 4] = 0;
+  char *p = replybuffer + replyLength(REPLY_CCLK) + 1;
+  replybuffer[len - 4] = 0;
 
   readline(); // eat OK
 
   return p;
 }
 
-bool TinySIM800::connectGPRS(const __FlashStringHelper *apn,
-                             const __FlashStringHelper *username,
-                             const __FlashStringHelper *password)
+// Read the network time once; from then on it is kept by the millis() clock
+// and the *PSUTTZ/+CTZV URCs (see enableNetworkTimeSync).
+bool TinySIM800::syncTime()
 {
-  if (isGPRSconnected())
-    return true;
+  getReply(CMD_CCLK_READ, (uint16_t)10000);
+  if (!parseClock())
+    return false;
 
-  //modem.isRegistered()
+  readline(); // eat OK
 
-  // set bearer profile! connection type GPRS
-  if (!sendCheckReply(F("AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\""),
-                      ok_reply, 10000))
-    return false;
+  return true;
+}
 
-  // set bearer profile access point name
-  if (apn)
+// Seconds since 1970-01-01 UTC, 0 if the time is not known (yet). Until
+// it is, the modem is asked at most every FONA_TIME_SYNC_RETRY_MS: a modem
+// without network time would otherwise hold up every call for the AT+CCLK?.
+uint32_t TinySIM800::now()
+{
+  poll();
+
+  if (!_timeValid)
   {
-    // Send command AT+SAPBR=3,1,"APN","<apn value>" where <apn value> is the configured APN value.
-    if (!sendCheckReplyQuoted(F("AT+SAPBR=3,1,\"APN\","), apn, ok_reply, 10000))
-      return false;
+    if (_syncAttempted && millis() - _lastSyncAttempt < FONA_TIME_SYNC_RETRY_MS)
+      return 0;
 
-    // send AT+CSTT,"apn","user","pass"
-    flushInput();
+    _syncAttempted = true;
+    _lastSyncAttempt = millis();
+    if (!syncTime())
+      return 0;
+  }
 
-    mySerial.print(F("AT+CSTT=\""));
-    mySerial.print(apn);
-    if (apnusername)
-    {
-      mySerial.print("\",\"");
-      mySerial.print(apnusername);
-    }
-    if (apnpassword)
-    {
-      mySerial.print("\",\"");
-      mySerial.print(apnpassword);
-    }
-    mySerial.println("\"");
+  // move the reference forward, so millis() wrapping around doesn't matter
+  uint32_t elapsed = (millis() - _epochMillis) / 1000;
+  _epoch += elapsed;
+  _epochMillis += elapsed * 1000;
 
-    if (!expectReply(ok_reply))
-      return false;
+  return _epoch;
+}
 
-    // set username/password
-    if (apnusername)
-    {
-      // Send command AT+SAPBR=3,1,"USER","<user>" where <user> is the configured APN username.
-      if (!sendCheckReplyQuoted(F("AT+SAPBR=3,1,\"USER\","), apnusername, ok_reply, 10000))
-        return false;
-    }
-    if (apnpassword)
-    {
-      // Send command AT+SAPBR=3,1,"PWD","<password>" where <password> is the configured APN password.
-      if (!sendCheckReplyQuoted(F("AT+SAPBR=3,1,\"PWD\","), apnpassword, ok_reply, 10000))
-        return false;
-    }
-  }
+// Time zone in quarters of an hour
+int8_t TinySIM800::getTimeZone()
+{
+  return _timeZone;
+}
 
-  // open GPRS context
-  if (!sendCheckReply(F("AT+SAPBR=1,1"), ok_reply, 30000))
+bool TinySIM800::enableRTC(uint8_t i)
+{
+  if (!sendCheckReply(CMD_CLTS, i, REPLY_OK))
     return false;
 
-  // bring up wireless connection
-  if (!sendCheckReply(F("AT+CIICR"), ok_reply, 10000))
+  return sendCheckReply(CMD_AT_W, REPLY_OK);
+}
+
+// Local time, served from the cached clock. year is counted from 2000.
+bool TinySIM800::readRTC(uint8_t *year, uint8_t *month, uint8_t *date, uint8_t *hr, uint8_t *min, uint8_t *sec)
+{
+  uint32_t t = now();
+  if (t == 0)
     return false;
 
-  gprsConnected(this, NULL);
+  t += (int32_t)_timeZone * 15 * 60;
+
+  uint32_t days = t / 86400;
+  uint32_t seconds = t % 86400;
+
+  *hr = seconds / 3600;
+  *min = (seconds / 60) % 60;
+  *sec = seconds % 60;
+
+  // civil from days, see http://howardhinnant.github.io/date_algorithms.html
+  days += 719468;
+  uint32_t era = days / 146097;
+  uint32_t doe = days - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  uint8_t m = mp < 10 ? mp + 3 : mp - 9;
+
+  *date = doy - (153 * mp + 2) / 5 + 1;
+  *month = m;
+  *year = yoe + era * 400 + (m <= 2 ? 1 : 0) - 2000;
 
   return true;
 }
 
-bool TinySIM800::isGPRSconnected()
+// Read up to n signed numbers from p, skipping anything in between.
+static uint8_t parseNumbers(const char *p, int16_t *v, uint8_t n)
 {
-  uint16_t state;
+  uint8_t i = 0;
 
-  if (!sendParseReply(F("AT+CGATT?"), F("+CGATT: "), &state))
-    return false;
+  while (i < n && *p)
+  {
+    if (isdigit(*p) || ((*p == '+' || *p == '-') && isdigit(p[1])))
+    {
+      char *end;
+      v[i++] = strtol(p, &end, 10);
+      p = end;
+    }
+    else
+      p++;
+  }
 
-  return (1 == state);
+  return i;
 }
 
-bool TinySIM800::disconnectGPRS()
+static uint32_t toEpoch(int16_t year, uint8_t month, uint8_t day, uint8_t hr, uint8_t min, uint8_t sec)
 {
-  // disconnect all sockets
-  if (!sendCheckReply(F("AT+CIPSHUT"), F("SHUT OK"), 20000))
+  // days from civil, see http://howardhinnant.github.io/date_algorithms.html
+  year -= month <= 2;
+  uint32_t era = year / 400;
+  uint32_t yoe = year - era * 400;
+  uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  uint32_t days = era * 146097 + doe - 719468;
+
+  return days * 86400 + hr * 3600UL + min * 60UL + sec;
+}
+
+void TinySIM800::setClock(uint32_t epoch)
+{
+  _epoch = epoch;
+  _epochMillis = millis();
+  _timeValid = true;
+}
+
+// +CCLK: "yy/MM/dd,hh:mm:ss+zz" in replybuffer, local time
+bool TinySIM800::parseClock()
+{
+  int16_t v[7];
+
+  if (parseNumbers(replybuffer + replyLength(REPLY_CCLK), v, 7) != 7)
+    return false;
+  if (v[1] < 1 || v[1] > 12 || v[2] < 1)
     return false;
 
-  // close GPRS context
-  if (!sendCheckReply(F("AT+SAPBR=0,1"), ok_reply, 10000))
+  // a modem that never heard from the network counts from 2004
+  if (v[0] < 10)
     return false;
 
-  if (!sendCheckReply(F("AT+CGATT=0"), ok_reply, 10000))
+  _timeZone = v[6];
+  setClock(toEpoch(2000 + v[0], v[1], v[2], v[3], v[4], v[5]) - (int32_t)v[6] * 15 * 60);
+
+  return true;
+}
+
+// *PSUTTZ: yyyy,MM,dd,hh,mm,ss,"+zz",dst in replybuffer, universal time
+bool TinySIM800::parseNetworkTime()
+{
+  int16_t v[7];
+
+  if (parseNumbers(replybuffer + replyLength(REPLY_PSUTTZ), v, 7) != 7)
+    return false;
+  if (v[0] < 2000 || v[1] < 1 || v[1] > 12 || v[2] < 1)
     return false;
 
-  gprsDisconnected(this, NULL);
+  _timeZone = v[6];
+  setClock(toEpoch(v[0], v[1], v[2], v[3], v[4], v[5]));
 
   return true;
 }
 
-// TCP
+/********* GNSS **********************************************************/
 
-bool TinySIM800::TCPconnect(char *server, uint16_t port)
+bool TinySIM800::enableGNSS(bool onoff)
 {
-  flushInput();
+  return sendCheckReply(CMD_CGNSPWR, onoff ? 1 : 0, REPLY_OK);
+}
 
-  // close all old connections
-  if (!sendCheckReply(F("AT+CIPSHUT"), F("SHUT OK"), 20000))
+bool TinySIM800::getGNSSFix(GNSSFix *fix)
+{
+  getReply(CMD_CGNSINF);
+  if (!isReplyPrefix(REPLY_CGNSINF))
     return false;
 
-  // single connection at a time
-  if (!sendCheckReply(F("AT+CIPMUX=0"), ok_reply))
-    return false;
+  bool ok = parseGNSS(replybuffer + replyLength(REPLY_CGNSINF), fix);
 
-  // manually read data
-  if (!sendCheckReply(F("AT+CIPRXGET=1"), ok_reply))
-    return false;
+  readline(); // eat 'OK'
 
-  mySerial.print(F("AT+CIPSTART=\"TCP\",\""));
-  mySerial.print(server);
-  mySerial.print(F("\",\""));
-  mySerial.print(port);
-  mySerial.println(F("\""));
+  return ok && fix->fixed;
+}
 
-  if (!expectReply(ok_reply))
-    return false;
-  if (!expectReply(F("CONNECT OK")))
-    return false;
+// Have a fix reported as +UGNSINF URC every so many fixes (0 to stop); it
+// is passed on through the gnssFix event, from poll().
+bool TinySIM800::enableGNSSURC(uint8_t fixes)
+{
+  return sendCheckReply(CMD_CGNSURC, fixes, REPLY_OK);
+}
 
-  // looks like it was a success (?)
-  return true;
+// v * 10 + digit, saturating on garbage instead of overflowing.
+static int32_t shift10(int32_t v, uint8_t digit)
+{
+  return v < (0x7FFFFFFFL - 9) / 10 ? v * 10 + digit : 0x7FFFFFFFL;
 }
 
-bool TinySIM800::TCPclose()
+// Decimal number in p as an integer with the given number of decimals.
+static int32_t parseFixed(const char *&p, uint8_t decimals)
 {
-  return sendCheckReply(F("AT+CIPCLOSE"), ok_reply);
+  bool negative = (*p == '-');
+  if (*p == '-' || *p == '+')
+    p++;
+
+  int32_t v = 0;
+  while (isdigit(*p))
+    v = shift10(v, *p++ - '0');
+
+  uint8_t d = 0;
+  if (*p == '.')
+  {
+    p++;
+    for (; isdigit(*p); p++)
+      if (d < decimals)
+      {
+        v = shift10(v, *p - '0');
+        d++;
+      }
+  }
+  for (; d < decimals; d++)
+    v = shift10(v, 0);
+
+  return negative ? -v : v;
 }
 
-bool TinySIM800::TCPconnected()
+// <run>,<fix>,<utc yyyyMMddhhmmss.sss>,<lat>,<lon>,<alt>,<speed>,<course>,
+// <mode>,,<hdop>,<pdop>,<vdop>,,<in view>,<used>,<glonass used>,...
+// All fields in one pass, empty fields are left 0.
+bool TinySIM800::parseGNSS(const char *p, GNSSFix *fix)
 {
-  if (!sendCheckReply(F("AT+CIPSTATUS"), ok_reply, 100))
+  memset(fix, 0, sizeof(GNSSFix));
+
+  for (uint8_t field = 0;; field++)
+  {
+    switch (field)
+    {
+    case 1:
+      fix->fixed = (*p == '1');
+      break;
+    case 2:
+    {
+      int16_t v[6];
+      uint8_t n = 0;
+      for (; n < 6 && isdigit(p[0]) && isdigit(p[1]); n++)
+      {
+        uint8_t digits = (n == 0) ? 4 : 2;
+        v[n] = 0;
+        for (uint8_t i = 0; i < digits && isdigit(*p); i++)
+          v[n] = v[n] * 10 + (*p++ - '0');
+      }
+      if (n == 6 && v[1] >= 1 && v[1] <= 12)
+        fix->time = toEpoch(v[0], v[1], v[2], v[3], v[4], v[5]);
+      break;
+    }
+    case 3:
+      fix->lat = parseFixed(p, 6);
+      break;
+    case 4:
+      fix->lon = parseFixed(p, 6);
+      break;
+    case 5:
+      fix->alt = parseFixed(p, 1);
+      break;
+    case 6:
+      fix->speed = parseFixed(p, 2);
+      break;
+    case 7:
+      fix->course = parseFixed(p, 2);
+      break;
+    case 10:
+    {
+      int32_t hdop = parseFixed(p, 1);
+      fix->hdop = (hdop > 255) ? 255 : hdop;
+      break;
+    }
+    case 14:
+      fix->satsInView = parseFixed(p, 0);
+      break;
+    case 15:
+      fix->satsUsed = parseFixed(p, 0);
+      break;
+    }
+
+    // on to the next field
+    while (*p && *p != ',')
+      p++;
+    if (*p == ',')
+      p++;
+    else
+      return field >= 8;
+  }
+}
+
+bool TinySIM800::connectGPRS(const __FlashStringHelper *apn,
+                             const __FlashStringHelper *username,
+                             const __FlashStringHelper *password)
+{
+  if (isGPRSconnected())
+    return true;
+
+  if (!breakerAllows())
+    return false;
+
+  //modem.isRegistered()
+
+  // set bearer profile! connection type GPRS
+  if (!retry([&]() { return sendCheckReply(CMD_SAPBR_CONTYPE, REPLY_OK, 10000); }))
+    return breakerRecord(false);
+
+  // set bearer profile access point name
+  if (apn)
+  {
+    // Send command AT+SAPBR=3,1,"APN","<apn value>" where <apn value> is the configured APN value.
+    if (!retry([&]() { return sendCheckReplyQuoted(CMD_SAPBR_APN, apn, REPLY_OK, 10000); }))
+      return breakerRecord(false);
+
+    // send AT+CSTT,"apn","user","pass"
+    if (!retry([&]() {
+          flushInput();
+
+          sendCommand(CMD_CSTT);
+          mySerial.print(apn);
+          if (apnusername)
+          {
+            mySerial.print("\",\"");
+            mySerial.print(apnusername);
+          }
+          if (apnpassword)
+          {
+            mySerial.print("\",\"");
+            mySerial.print(apnpassword);
+          }
+          mySerial.println("\"");
+
+          return expectReply(REPLY_OK);
+        }))
+      return breakerRecord(false);
+
+    // set username/password
+    if (apnusername)
+    {
+      // Send command AT+SAPBR=3,1,"USER","<user>" where <user> is the configured APN username.
+      if (!retry([&]() { return sendCheckReplyQuoted(CMD_SAPBR_USER, apnusername, REPLY_OK, 10000); }))
+        return breakerRecord(false);
+    }
+    if (apnpassword)
+    {
+      // Send command AT+SAPBR=3,1,"PWD","<password>" where <password> is the configured APN password.
+      if (!retry([&]() { return sendCheckReplyQuoted(CMD_SAPBR_PWD, apnpassword, REPLY_OK, 10000); }))
+        return breakerRecord(false);
+    }
+  }
+
+  // open GPRS context
+  if (!retry([&]() { return sendCheckReply(CMD_SAPBR_OPEN, REPLY_OK, 30000); }))
+    return breakerRecord(false);
+
+  // bring up wireless connection
+  if (!retry([&]() { return sendCheckReply(CMD_CIICR, REPLY_OK, 10000); }))
+    return breakerRecord(false);
+
+  breakerRecord(true);
+
+  gprsConnected(this, NULL);
+
+  return true;
+}
+
+bool TinySIM800::isGPRSconnected()
+{
+  uint16_t state;
+
+  if (!sendParseReply(CMD_CGATT_READ, REPLY_CGATT, &state))
+    return false;
+
+  return (1 == state);
+}
+
+bool TinySIM800::disconnectGPRS()
+{
+  _tcpConfigured = false;
+  _tcpOpen = false;
+
+  // disconnect all sockets
+  if (!sendCheckReply(CMD_CIPSHUT, REPLY_SHUT_OK, 20000))
+    return false;
+
+  // close GPRS context
+  if (!sendCheckReply(CMD_SAPBR_CLOSE, REPLY_OK, 10000))
+    return false;
+
+  if (!sendCheckReply(CMD_CGATT, 0, REPLY_OK, 10000))
+    return false;
+
+  gprsDisconnected(this, NULL);
+
+  return true;
+}
+
+// TCP
+
+bool TinySIM800::TCPconnect(char *server, uint16_t port)
+{
+  if (!breakerAllows())
+    return false;
+
+  // connect by IP address if we know it
+  char ip[DNS_IP_LEN];
+  char *host = server;
+  if (_dns && lookupHost(server, ip))
+    server = ip;
+
+  flushInput();
+
+  if (_tcpConfigured)
+  {
+    // The socket settings and the PDP context are still good, only the
+    // old connection has to go.
+    if (_tcpOpen)
+      TCPclose();
+
+    if (TCPstart(server, port))
+      return breakerRecord(true);
+
+    // the cached address may be stale as well
+    if (_dns && server != host)
+    {
+      _dns->invalidate(host);
+      server = host;
+    }
+
+    // the modem is not in the state we thought, start over
+    _tcpConfigured = false;
+  }
+
+  // close all old connections
+  if (!retry([&]() { return sendCheckReply(CMD_CIPSHUT, REPLY_SHUT_OK, 20000); }))
+    return breakerRecord(false);
+
+  // single connection at a time
+  if (!retry([&]() { return sendCheckReply(CMD_CIPMUX, 0, REPLY_OK); }))
+    return breakerRecord(false);
+
+  // manually read data
+  if (!retry([&]() { return sendCheckReply(CMD_CIPRXGET, 1, REPLY_OK); }))
+    return breakerRecord(false);
+
+  _tcpConfigured = true;
+
+  if (!retry([&]() { return TCPstart(server, port); }))
+    return breakerRecord(false);
+
+  // looks like it was a success (?)
+  return breakerRecord(true);
+}
+
+void TinySIM800::setDNSCache(DNSCache *dns)
+{
+  _dns = dns;
+}
+
+// Resolve host to a dotted IP address with the modem's resolver.
+bool TinySIM800::resolve(const char *host, char *ip, uint8_t len)
+{
+  flushInput();
+
+  sendCommand(CMD_CDNSGIP);
+  mySerial.print(host);
+  mySerial.println(F("\""));
+
+  if (!expectReply(REPLY_OK))
+    return false;
+
+  // +CDNSGIP: 1,"<host>","<ip>" or +CDNSGIP: 0,<error>
+  awaitReply(REPLY_CDNSGIP, 10000);
+
+  uint16_t success;
+  if (!parseReply(replyText(REPLY_CDNSGIP), &success, ',', 0) || success != 1)
+    return false;
+
+  return parseReplyQuoted(replyText(REPLY_CDNSGIP), ip, len, ',', 2);
+}
+
+// IP address of host from the cache, resolving it if needed
+bool TinySIM800::lookupHost(const char *host, char *ip)
+{
+  // already an address
+  if (strspn(host, "0123456789.") == strlen(host))
+    return false;
+
+  const char *cached = _dns->lookup(host);
+  if (cached == NULL)
+  {
+    if (!resolve(host, ip, DNS_IP_LEN - 1))
+      return false;
+    ip[DNS_IP_LEN - 1] = 0;
+
+    _dns->store(host, ip);
+    return true;
+  }
+
+  strcpy(ip, cached);
+  return true;
+}
+
+bool TinySIM800::TCPstart(char *server, uint16_t port)
+{
+  flushInput();
+
+  sendCommand(CMD_CIPSTART);
+  mySerial.print(server);
+  mySerial.print(F("\",\""));
+  mySerial.print(port);
+  mySerial.println(F("\""));
+
+  if (!expectReply(REPLY_OK))
+    return false;
+  awaitReply(REPLY_CONNECT_OK, 10000);
+  if (!isReply(REPLY_CONNECT_OK))
+    return false;
+
+  _tcpOpen = true;
+  return true;
+}
+
+bool TinySIM800::TCPclose()
+{
+  _tcpOpen = false;
+
+  return sendCheckReply(CMD_CIPCLOSE, REPLY_CLOSE_OK);
+}
+
+bool TinySIM800::TCPconnected()
+{
+  if (!sendCheckReply(CMD_CIPSTATUS, REPLY_OK, 100))
     return false;
   readline(100);
 
-  return (strcmp(replybuffer, "STATE: CONNECT OK") == 0);
-}
+  _tcpOpen = isReply(REPLY_STATE_CONNECT_OK);
+  if (isReply(REPLY_STATE_PDP_DEACT))
+    _tcpConfigured = false;
+
+  return _tcpOpen;
+}
+
+bool TinySIM800::TCPsend(char *packet, uint8_t len)
+{
+  flushInput();
+
+  sendCommand(CMD_CIPSEND);
+  mySerial.println(len);
+
+  if (!expectPrompt())
+    return false;
+
+  _paced.begin();
+  _paced.write(packet, len);
+  if (_paced.failed())
+  {
+    mySerial.write(0x1B); // ESC: cancel the send, or the modem stays in data mode
+    flushInput();
+    return false;
+  }
+  readline(3000); // wait up to 3 seconds to send the data
+
+  return isReply(REPLY_SEND_OK);
+}
+
+// Same as above, but the packet is written straight to the modem by
+// ptrStreamPacket (e.g. by a CborWriter) instead of from a buffer.
+bool TinySIM800::TCPsend(uint16_t (*ptrMeasurePacket)(), void (*ptrStreamPacket)(Stream &))
+{
+  flushInput();
+
+  sendCommand(CMD_CIPSEND);
+  mySerial.println(ptrMeasurePacket());
+
+  if (!expectPrompt())
+    return false;
+
+  _paced.begin();
+  ptrStreamPacket(_paced);
+  if (_paced.failed())
+  {
+    mySerial.write(0x1B); // ESC: cancel the send, or the modem stays in data mode
+    flushInput();
+    return false;
+  }
+  readline(3000); // wait up to 3 seconds to send the data
+
+  return isReply(REPLY_SEND_OK);
+}
+
+uint16_t TinySIM800::TCPavailable()
+{
+  uint16_t avail;
+
+  if (!sendParseReply(CMD_CIPRXGET_AVAILABLE, REPLY_CIPRXGET_4, &avail, ',', 0))
+    return false;
+
+  DEBUG_PRINT(avail);
+  DEBUG_PRINTLN(F(" bytes available"));
+
+  return avail;
+}
+
+uint16_t TinySIM800::TCPread(uint8_t *buff, uint8_t len, uint16_t *left)
+{
+  uint16_t avail;
+
+  sendCommand(CMD_CIPRXGET);
+  mySerial.print(2);
+  mySerial.print(',');
+  mySerial.println(len);
+
+  readline();
+
+  // +CIPRXGET: 2,<read>,<left>
+  if (!parseReply(replyText(REPLY_CIPRXGET_2), &avail, ',', 0))
+  {
+    return false;
+  }
+  if (left && !parseReply(replyText(REPLY_CIPRXGET_2), left, ',', 1))
+    *left = 0;
+
+  // never hand out more than asked for, or than fits in replybuffer
+  avail = readRaw(min(avail, (uint16_t)len));
+
+  DEBUG_PRINT(avail);
+  DEBUG_PRINTLN(F(" bytes read"));
+  for (uint8_t i = 0; i < avail; i++)
+  {
+    DEBUG_PRINT(F(" 0x"));
+    DEBUG_PRINT(replybuffer[i], HEX);
+  }
+  DEBUG_PRINTLN();
+
+  memcpy(buff, replybuffer, avail);
+
+  readline(); // eat 'OK'
+
+  return avail;
+}
+
+// HTTP
+
+bool TinySIM800::initiateHTTP(const char *url, const char *headers)
+{
+  beforeHTTPConnect(this, NULL);
+
+  // Init HTTP connection
+  if (!retry([&]() { return sendCheckReply(CMD_HTTPINIT, REPLY_OK, 100); }))
+    return false;
+
+  // Connect HTTP through GPRS bearer
+  if (!retry([&]() { return sendCheckReply(CMD_HTTPPARA_CID, REPLY_OK, 100); }))
+    return false;
+
+  if (!retry([&]() {
+        flushInput();
+
+        sendCommand(CMD_HTTPPARA_URL);
+        mySerial.print(url);
+        mySerial.println(F("\""));
+        return expectReply(REPLY_OK);
+      }))
+    return false;
+
+  // expecting a json reply
+  if (!retry([&]() { return sendCheckReply(CMD_HTTPPARA_CONTENT, REPLY_OK, 100); }))
+    return false;
+
+  // extra request headers, "Name: value"; several are separated by the four
+  // characters \r\n, a CR would end the command
+  if (headers != NULL)
+    if (!retry([&]() {
+          flushInput();
+
+          sendCommand(CMD_HTTPPARA_USERDATA);
+          mySerial.print(headers);
+          mySerial.println(F("\""));
+          return expectReply(REPLY_OK);
+        }))
+      return false;
+
+  return true;
+}
+
+bool TinySIM800::postHTTP(const char *url,
+                          const char *headers,
+                          uint16_t (*ptrMeasureBody)(),
+                          void (*ptrStreamBody)(Stream &),
+                          void (*ptrStatusCode)(const uint16_t),
+                          void (*ptrResponse)(char *))
+{
+  if (!breakerAllows())
+    return false;
+
+  if (!initiateHTTP(url, headers))
+  {
+    terminateHTTP(); // or the next HTTPINIT fails
+    return breakerRecord(false);
+  }
+
+  uint16_t length = ptrMeasureBody();
+
+  if (!retry([&]() {
+        flushInput();
+
+        sendCommand(CMD_HTTPDATA);
+        mySerial.print(length);
+        mySerial.print(F(","));
+        mySerial.println(10000);
+
+        return expectReply(REPLY_DOWNLOAD);
+      }))
+  {
+    terminateHTTP();
+    return breakerRecord(false);
+  }
+
+  // The modem is in data mode until it has length bytes: the body goes out
+  // once, a failure can't be retried from here.
+  _paced.begin(length);
+  ptrStreamBody(_paced);
+  if (_paced.failed())
+    _paced.pad();
+
+  if (!expectReply(REPLY_OK) || _paced.failed())
+  {
+    terminateHTTP();
+    return breakerRecord(false);
+  }
+
+  // do POST, initial answer is OK, second part is +HTTPACTION:
+  uint16_t statusCode = 0;
+  uint16_t dataLength = 0;
+  // Only the command is retried: once it is accepted the POST may have
+  // reached the server, even if +HTTPACTION doesn't come.
+  if (!retry([&]() { return sendCheckReply(CMD_HTTPACTION_POST, REPLY_OK, 100); }))
+  {
+    terminateHTTP();
+    return breakerRecord(false);
+  }
+
+  awaitReply(REPLY_HTTPACTION_1, 10000);
+  if (!parseReply(replyText(REPLY_HTTPACTION_1), &statusCode, ',', 0) ||
+      !parseReply(replyText(REPLY_HTTPACTION_1), &dataLength, ',', 1))
+  {
+    terminateHTTP();
+    return breakerRecord(false);
+  }
+
+  breakerRecord(true);
+
+  if (ptrStatusCode)
+    ptrStatusCode(statusCode);
+
+  if (ptrResponse)
+  {
+    int step = sizeof(replybuffer) - 1;
+    for (int i = 0; i < dataLength; i += step)
+    {
+      auto amount = (dataLength - i) > step ? step : (dataLength - i);
+
+      sendCommand(CMD_HTTPREAD);
+      mySerial.print(i);
+      mySerial.print(",");
+      mySerial.println(amount);
+
+      expectReply(REPLY_HTTPREAD);
+
+      readRaw(amount);
+
+      ptrResponse(replybuffer);
+
+      flushInput();
+    }
+  }
+
+  if (!terminateHTTP())
+    return false;
+
+  return true;
+}
+
+// Download url into sink. The file is fetched in ranges (AT+HTTPPARA
+// "BREAK"/"BREAKEND") of segment bytes, each read back with AT+HTTPREAD in
+// pieces of chunk bytes that are passed on to the sink as they come in.
+// After a failure, call again with the same state to resume.
+bool TinySIM800::downloadHTTP(const char *url, DownloadSink &sink, DownloadState &state,
+                              uint32_t segment, uint16_t chunk)
+{
+  if (state.complete)
+    return true;
+
+  if (!breakerAllows())
+    return false;
+
+  if (!initiateHTTP(url))
+  {
+    terminateHTTP();
+    return breakerRecord(false);
+  }
+
+  uint32_t start = millis();
+  bool last = false;
+  bool ok = true;
+
+  while (ok && !last)
+    ok = retry([&]() { return downloadSegment(sink, state, segment, chunk, &last); });
+
+  state.elapsed += millis() - start;
+  state.complete = ok;
+
+  terminateHTTP();
+
+  return breakerRecord(ok);
+}
+
+bool TinySIM800::downloadSegment(DownloadSink &sink, DownloadState &state, uint32_t segment, uint16_t chunk, bool *last)
+{
+  if (!sendCheckReply(CMD_HTTPPARA_BREAK, state.offset, REPLY_OK, 100))
+    return false;
+  if (!sendCheckReply(CMD_HTTPPARA_BREAKEND, state.offset + segment - 1, REPLY_OK, 100))
+    return false;
+
+  // GET, initial answer is OK, second part is +HTTPACTION: 0,<status>,<length>
+  if (!sendCheckReply(CMD_HTTPACTION_GET, REPLY_OK, 100))
+    return false;
+  awaitReply(REPLY_HTTPACTION_0, 60000);
+
+  uint16_t status = 0;
+  if (!parseReply(replyText(REPLY_HTTPACTION_0), &status, ',', 0))
+    return false;
+
+  // +HTTPACTION reports the length as a 32 bit number
+  char *p = strrchr(replybuffer, ',');
+  uint32_t length = p ? strtoul(p + 1, NULL, 10) : 0;
+
+  if (status == 416)
+  {
+    // asked for a range past the end, the previous segment was the last
+    *last = true;
+    return true;
+  }
+  if (status == 200 && state.offset > 0)
+  {
+    DEBUG_PRINTLN(F("Server does not support ranges, cannot resume"));
+    return false;
+  }
+  if (status != 200 && status != 206)
+    return false;
+
+  // a server that ignores the range sends everything at once
+  *last = (status == 200 || length < segment);
+
+  for (uint32_t pos = 0; pos < length;)
+  {
+    uint16_t amount = min((uint32_t)chunk, length - pos);
+
+    flushInput();
+
+    sendCommand(CMD_HTTPREAD);
+    mySerial.print(pos);
+    mySerial.print(',');
+    mySerial.println(amount);
+
+    readline();
+    uint16_t count;
+    if (!parseReply(replyText(REPLY_HTTPREAD), &count, ',', 0) || count == 0)
+      return false;
+
+    // pass it on in pieces that fit replybuffer
+    for (uint16_t done = 0; done < count;)
+    {
+      uint16_t n = readRaw(min((uint16_t)(count - done), (uint16_t)(sizeof(replybuffer) - 1)));
+      if (n == 0)
+        return false;
+
+      if (!sink.write(state.offset, (uint8_t *)replybuffer, n))
+        return false;
 
-bool TinySIM800::TCPsend(char *packet, uint8_t len)
-{
-  mySerial.print(F("AT+CIPSEND="));
-  mySerial.println(len);
-  readline();
+      state.crc.update((uint8_t *)replybuffer, n);
+      if (state.sha)
+        state.sha->update((uint8_t *)replybuffer, n);
+      state.offset += n;
+      state.received += n;
 
-  if (replybuffer[0] != '>')
-    return false;
+      done += n;
+      pos += n;
+    }
 
-  mySerial.write(packet, len);
-  readline(3000); // wait up to 3 seconds to send the data
+    if (!expectReply(REPLY_OK))
+      return false;
+  }
 
-  return (strcmp(replybuffer, "SEND OK") == 0);
+  return true;
 }
 
-uint16_t TinySIM800::TCPavailable()
+void TinySIM800::setRetryPolicy(const RetryPolicy &policy)
 {
-  uint16_t avail;
-
-  if (!sendParseReply(F("AT+CIPRXGET=4"), F("+CIPRXGET: 4,"), &avail, ',', 0))
-    return false;
+  _retryPolicy = policy;
+}
 
-  DEBUG_PRINT(avail);
-  DEBUG_PRINTLN(F(" bytes available"));
+// Exponential backoff with (equal) jitter: half the delay is fixed, the
+// other half random, so units that failed together don't retry together.
+uint16_t TinySIM800::backoff(uint8_t attempt)
+{
+  // a 16 bit backoff shifted by up to 15 still fits, more is undefined
+  uint8_t shift = attempt - 1 < 15 ? attempt - 1 : 15;
+  uint32_t d = (uint32_t)_retryPolicy.backoff << shift;
+  if (d > _retryPolicy.maxBackoff)
+    d = _retryPolicy.maxBackoff;
 
-  return avail;
+  return d / 2 + random(d / 2 + 1);
 }
 
-uint16_t TinySIM800::TCPread(uint8_t *buff, uint8_t len)
+// While the breaker is open operations fail straight away. After the
+// cooldown one operation is let through to probe the network again.
+bool TinySIM800::breakerAllows()
 {
-  uint16_t avail;
-
-  mySerial.print(F("AT+CIPRXGET=2,"));
-  mySerial.println(len);
+  if (!_breakerOpen)
+    return true;
 
-  readline();
+  return (millis() - _breakerOpenedAt >= _retryPolicy.breakerCooldown);
+}
 
-  if (!parseReply(F("+CIPRXGET: 2,"), &avail, ',', 0))
+// Book the outcome of an operation, returns success.
+bool TinySIM800::breakerRecord(bool success)
+{
+  if (success)
   {
-    return false;
+    _failures = 0;
+    _breakerOpen = false;
+    return true;
   }
 
-  readRaw(avail);
+  if (_retryPolicy.breakerThreshold == 0)
+    return false;
 
-  DEBUG_PRINT(avail);
-  DEBUG_PRINTLN(F(" bytes read"));
-  for (uint8_t i = 0; i < avail; i++)
+  if (++_failures >= _retryPolicy.breakerThreshold)
   {
-    DEBUG_PRINT(F(" 0x"));
-    DEBUG_PRINT(replybuffer[i], HEX);
+    DEBUG_PRINTLN(F("Circuit breaker open"));
+    _breakerOpen = true;
+    _breakerOpenedAt = millis();
+    _breakerTrips++;
   }
-  DEBUG_PRINTLN();
-
-  memcpy(buff, replybuffer, avail);
 
-  return avail;
+  return false;
 }
 
-// HTTP
-
-bool TinySIM800::initiateHTTP(const char *url, const char *headers)
+bool TinySIM800::terminateHTTP()
 {
-  beforeHTTPConnect(this, NULL);
-
-  // Init HTTP connection
-  if (!sendCheckReply(F("AT+HTTPINIT"), ok_reply, 100))
+  if (!sendCheckReply(CMD_HTTPTERM, REPLY_OK, 100))
     return false;
 
-  // Connect HTTP through GPRS bearer
-  if (!sendCheckReply(F("AT+HTTPPARA=\"CID\",1"), ok_reply, 100))
-    return false;
-
-  mySerial.print(F("AT+HTTPPARA=\"URL\",\""));
-  mySerial.print(url);
-  mySerial.println(F("\""));
-  if (!expectReply(ok_reply))
-    return;
+  afterHTTPDisconnect(this, NULL);
 
-  // expecting a json reply
-  if (!sendCheckReply(F("AT+HTTPPARA=\"CONTENT\",\"application/json\"\r\n"), ok_reply, 100))
-    return false;
+  return true;
+}
 
-  if (headers != NULL)
-    if (!sendCheckReply(F("AT+HTTPPARA=\"USERDATA\","), ok_reply, 100))
-      return false;
+/********* HELPERS *********************************************/
 
-  return true;
+void TinySIM800::setAdaptiveTimeout(AdaptiveTimeout *adaptive)
+{
+  _adaptive = adaptive;
 }
 
-bool TinySIM800::postHTTP(const char *url,
-                          const char *headers,
-                          uint16_t (*ptrMeasureBody)(),
-                          void (*ptrStreamBody)(const Stream &),
-                          void (*ptrStatusCode)(const uint16_t),
-                          void (*ptrResponse)(char *))
+uint16_t TinySIM800::adaptTimeout(const __FlashStringHelper *command, uint16_t timeout)
 {
-  if (!initiateHTTP(url, headers))
-    return false;
+  if (_adaptive == NULL)
+    return timeout;
 
-  mySerial.print(F("AT+HTTPDATA="));
-  mySerial.print(ptrMeasureBody());
-  mySerial.print(F(","));
-  mySerial.println(10000);
+  return _adaptive->timeout(command, timeout);
+}
 
-  if (!expectReply(F("DOWNLOAD")))
+// No reply at all counts as having taken the full timeout.
+void TinySIM800::learnTimeout(const __FlashStringHelper *command, uint32_t start, uint16_t timeout, uint8_t replylen)
+{
+  if (_adaptive == NULL)
     return;
 
-  ptrStreamBody(mySerial);
+  uint32_t latency = millis() - start;
+  if (replylen == 0 && latency < timeout)
+    latency = timeout;
 
-  delay(100);
-
-  // do POST, initial answer is OK, second part is +HTTPACTION:
-  if (!sendCheckReply(F("AT+HTTPACTION=1"), ok_reply, 100))
-    return;
-  readline(10000);
-  uint16_t statusCode = 0;
-  if (!parseReply(F("+HTTPACTION: 1,"), &statusCode, ',', 0))
-    return false;
-  uint16_t dataLength = 0;
-  if (!parseReply(F("+HTTPACTION: 1,"), &dataLength, ',', 1))
-    return false;
+  _adaptive->record(command, latency > 0xFFFF ? 0xFFFF : latency);
+}
 
-  if (ptrStatusCode)
-    ptrStatusCode(statusCode);
+// readline for a reply that comes long after its command (CONNECT OK,
+// +HTTPACTION: ...), with the timeout learned under the reply. Other lines
+// (errors) are not learned from.
+uint8_t TinySIM800::awaitReply(ATReply reply, uint16_t timeout)
+{
+  const __FlashStringHelper *text = replyText(reply);
 
-  if (ptrResponse)
-  {
-    int step = sizeof(replybuffer);
-    for (int i = 0; i < dataLength; i += step)
-    {
-      auto amount = (dataLength - i) > step ? step : (dataLength - i);
+  uint32_t start = millis();
+  uint8_t l = readline(adaptTimeout(text, timeout));
+  if (l == 0 || isReplyPrefix(reply))
+    learnTimeout(text, start, timeout, l);
 
-      mySerial.print(F("AT+HTTPREAD="));
-      mySerial.print(i);
-      mySerial.print(",");
-      mySerial.println(amount);
+  return l;
+}
 
-      expectReply(F("+HTTPREAD: "));
+bool TinySIM800::expectReply(const __FlashStringHelper *reply,
+                             uint16_t timeout)
+{
+  readline(timeout);
 
-      readRaw(amount);
+  return (prog_char_strcmp(replybuffer, (prog_char *)reply) == 0);
+}
 
-      ptrResponse(replybuffer);
+bool TinySIM800::expectReply(ATReply reply, uint16_t timeout)
+{
+  readline(timeout);
 
-      flushInput();
-    }
-  }
+  return isReply(reply);
+}
 
-  if (!terminateHTTP())
+// Compare the reply in replybuffer: length first, then the text.
+bool TinySIM800::isReply(ATReply reply)
+{
+  uint8_t len = replyLength(reply);
+  if (_replyLen != len)
     return false;
 
-  return true;
+  return memcmp_P(replybuffer, pgm_read_ptr(&replyTable[reply].text), len) == 0;
 }
 
-bool TinySIM800::terminateHTTP()
+// Whether the reply in replybuffer starts with reply.
+bool TinySIM800::isReplyPrefix(ATReply reply)
 {
-  if (!sendCheckReply(F("AT+HTTPTERM"), ok_reply, 100))
+  uint8_t len = replyLength(reply);
+  if (_replyLen < len)
     return false;
 
-  afterHTTPDisconnect(this, NULL);
-
-  return true;
+  return memcmp_P(replybuffer, pgm_read_ptr(&replyTable[reply].text), len) == 0;
 }
 
-/********* HELPERS *********************************************/
-
-bool TinySIM800::expectReply(const __FlashStringHelper *reply,
-                             uint16_t timeout)
+// "AT" and the command from the table, without newline (parameters follow)
+void TinySIM800::sendCommand(ATCommand command)
 {
-  readline(timeout);
-
-  return (prog_char_strcmp(replybuffer, (prog_char *)reply) == 0);
+  mySerial.print(F("AT"));
+  mySerial.print(commandText(command));
 }
 
 void TinySIM800::flushInput()
 {
-  // Read all available serial input to flush pending data.
-  uint16_t timeoutloop = 0;
-  while (timeoutloop++ < 40)
+  // Read all available serial input to flush pending data. Lines are read
+  // through readline, so URCs that arrived in the mean time are not lost.
+  // Stop once the line has been quiet for 40 ms.
+  uint32_t quiet = millis();
+  while (millis() - quiet < 40)
   {
-    while (mySerial.available())
+    while (inputAvailable())
     {
-      mySerial.read();
-      timeoutloop = 0; // If char was received reset the timer
+      readline(10);
+      quiet = millis(); // If char was received reset the timer
     }
     delay(1);
   }
 }
 
-uint16_t TinySIM800::readRaw(uint16_t b)
+// Whether the modem has sent anything. With RTS/CTS flow control it holds
+// its output while RTS is deasserted, so RTS is asserted for a moment to
+// let it through.
+bool TinySIM800::inputAvailable()
+{
+  if (_rts == NULL)
+    return mySerial.available();
+
+  _rts(true);
+  delay(1);
+  bool available = mySerial.available();
+  _rts(false);
+
+  return available;
+}
+
+uint16_t TinySIM800::readRaw(uint16_t b, uint16_t timeout)
 {
   uint16_t idx = 0;
+  uint32_t start = millis();
+
+  if (_rts)
+    _rts(true);
 
   while (b && (idx < sizeof(replybuffer) - 1))
   {
@@ -578,27 +1664,95 @@ uint16_t TinySIM800::readRaw(uint16_t b)
       idx++;
       b--;
     }
+    else if (millis() - start > timeout)
+    {
+      DEBUG_PRINTLN(F("TIMEOUT"));
+      break;
+    }
   }
   replybuffer[idx] = 0;
+  _replyLen = idx;
+
+  if (_rts)
+    _rts(false);
 
   return idx;
 }
 
+// Wait for the "> " prompt of AT+CIPSEND. It has no line end, so readline
+// would only return on its timeout. A line instead (ERROR) ends the wait.
+bool TinySIM800::expectPrompt(uint16_t timeout)
+{
+  uint16_t replyidx = 0;
+  uint32_t start = millis();
+  bool prompt = false;
+
+  if (_rts)
+    _rts(true);
+
+  while (millis() - start < timeout)
+  {
+    if (!mySerial.available())
+    {
+      delay(1);
+      continue;
+    }
+
+    char c = mySerial.read();
+    if (c == '>')
+    {
+      prompt = true;
+      break;
+    }
+    if (c == '\n' && replyidx > 0)
+      break;
+    if (c != '\r' && c != '\n' && replyidx < sizeof(replybuffer) - 1)
+      replybuffer[replyidx++] = c;
+  }
+
+  // the space after the '>'
+  while (prompt && millis() - start < timeout)
+  {
+    if (mySerial.peek() == ' ')
+    {
+      mySerial.read();
+      break;
+    }
+    if (mySerial.available())
+      break;
+    delay(1);
+  }
+
+  replybuffer[replyidx] = 0;
+  _replyLen = replyidx;
+  if (_rts)
+    _rts(false);
+
+  return prompt;
+}
+
 uint8_t TinySIM800::readline(uint16_t timeout, bool multiline)
 {
   uint16_t replyidx = 0;
+  uint32_t start = millis();
+  uint32_t last = start;
+  bool done = false;
+
+  if (_rts)
+    _rts(true);
 
-  while (timeout--)
+  while (!done)
   {
-    if (replyidx >= 127)
+    if (replyidx >= sizeof(replybuffer) - 1)
     {
       //DEBUG_PRINTLN(F("SPACE"));
       break;
     }
 
-    while (mySerial.available())
+    while (mySerial.available() && replyidx < sizeof(replybuffer) - 1)
     {
       char c = mySerial.read();
+      last = millis();
       if (c == '\r')
         continue;
       if (c == 0xA)
@@ -608,40 +1762,78 @@ uint8_t TinySIM800::readline(uint16_t timeout, bool multiline)
 
         if (!multiline)
         {
-          if (0 == strncmp(replybuffer, "*PSNWID:", strlen("*PSNWID:")))
+          replybuffer[replyidx] = 0;
+          _replyLen = replyidx;
+
+          if (isReplyPrefix(REPLY_CREG) && parseRegistration(false, false))
+          {
+            DEBUG_PRINTLN(F("### Network registration updated."));
+            replyidx = 0;
+          }
+          else if (isReplyPrefix(REPLY_CGREG) && parseRegistration(true, false))
+          {
+            DEBUG_PRINTLN(F("### GPRS registration updated."));
+            replyidx = 0;
+          }
+          else if (isReplyPrefix(REPLY_UGNSINF))
+          {
+            GNSSFix fix;
+            if (parseGNSS(replybuffer + replyLength(REPLY_UGNSINF), &fix))
+            {
+              _gnssFix = fix;
+              _gnssFixPending = true;
+            }
+            replyidx = 0;
+          }
+          else if (isReply(REPLY_CLOSED))
+          {
+            DEBUG_PRINTLN(F("### TCP connection closed by peer."));
+            _tcpOpen = false;
+            replyidx = 0;
+          }
+          else if (isReply(REPLY_PDP_DEACT))
+          {
+            DEBUG_PRINTLN(F("### PDP context deactivated."));
+            _tcpOpen = false;
+            _tcpConfigured = false;
+            replyidx = 0;
+          }
+          else if (isReplyPrefix(REPLY_PSNWID))
           {
             DEBUG_PRINTLN(F("### Network name updated."));
             replyidx = 0;
-            timeout = 30000;
           }
-          else if (0 == strncmp(replybuffer, "*PSUTTZ:", strlen("*PSUTTZ:")))
+          else if (isReplyPrefix(REPLY_PSUTTZ))
           {
             DEBUG_PRINTLN(F("### Network time and time zone updated."));
+            parseNetworkTime();
             replyidx = 0;
-            timeout = 30000;
           }
-          else if (0 == strncmp(replybuffer, "DST:", strlen("DST:")))
+          else if (isReplyPrefix(REPLY_DST))
           {
             DEBUG_PRINTLN(F("### Refresh Network Daylight Saving Time by network."));
             replyidx = 0;
-            timeout = 30000;
           }
-          else if (0 == strncmp(replybuffer, "+CTZV:", strlen("+CTZV:")))
+          else if (isReplyPrefix(REPLY_CTZV))
           {
             DEBUG_PRINTLN(F("### Network time zone updated."));
+            int16_t tz;
+            if (parseNumbers(replybuffer + replyLength(REPLY_CTZV), &tz, 1) == 1)
+              _timeZone = tz;
             replyidx = 0;
-            timeout = 30000;
           }
-          else if (0 == strncmp(replybuffer, "+HTTPACTION:", strlen("+HTTPACTION:")))
+          else if (isReplyPrefix(REPLY_HTTPACTION))
           {
+            // give the modem 100 ms more
+            start = millis();
             timeout = 100;
           }
-          else if (0 == strncmp(replybuffer, "+HTTPREAD:", strlen("+HTTPREAD:")))
+          else if (isReplyPrefix(REPLY_HTTPREAD))
           {
-            timeout = 0;
+            done = true;
           }
           else
-            timeout = 0; // the second 0x0A is the end of the line
+            done = true; // the second 0x0A is the end of the line
           break;
         }
       }
@@ -650,7 +1842,12 @@ uint8_t TinySIM800::readline(uint16_t timeout, bool multiline)
       replyidx++;
     }
 
-    if (timeout == 0)
+    if (done)
+      break;
+
+    // URCs handled above don't extend the deadline, but a line that has
+    // started is read to its end (poll's short timeout would cut it)
+    if (millis() - start >= timeout && (replyidx == 0 || millis() - last >= FONA_LINE_GAP_MS))
     {
       DEBUG_PRINTLN(F("TIMEOUT"));
       break;
@@ -660,6 +1857,10 @@ uint8_t TinySIM800::readline(uint16_t timeout, bool multiline)
   }
 
   replybuffer[replyidx] = 0; // null term
+  _replyLen = replyidx;
+  if (_rts)
+    _rts(false);
+
   return replyidx;
 }
 
@@ -680,7 +1881,71 @@ uint8_t TinySIM800::getReply(const __FlashStringHelper *send, uint16_t timeout)
 
   mySerial.println(send);
 
-  uint8_t l = readline(timeout);
+  uint32_t start = millis();
+  uint8_t l = readline(adaptTimeout(send, timeout));
+  learnTimeout(send, start, timeout, l);
+
+  return l;
+}
+
+// Send a command from the table and newline. Adaptive timeouts are kept
+// per table entry.
+uint8_t TinySIM800::getReply(ATCommand command, uint16_t timeout)
+{
+  flushInput();
+
+  sendCommand(command);
+  mySerial.println();
+
+  uint32_t start = millis();
+  uint8_t l = readline(adaptTimeout(commandText(command), timeout));
+  learnTimeout(commandText(command), start, timeout, l);
+
+  return l;
+}
+
+uint8_t TinySIM800::getReply(ATCommand command, int32_t suffix, uint16_t timeout)
+{
+  flushInput();
+
+  sendCommand(command);
+  mySerial.println(suffix, DEC);
+
+  uint32_t start = millis();
+  uint8_t l = readline(adaptTimeout(commandText(command), timeout));
+  learnTimeout(commandText(command), start, timeout, l);
+
+  return l;
+}
+
+uint8_t TinySIM800::getReply(ATCommand command, int32_t suffix1, int32_t suffix2, uint16_t timeout)
+{
+  flushInput();
+
+  sendCommand(command);
+  mySerial.print(suffix1);
+  mySerial.print(',');
+  mySerial.println(suffix2, DEC);
+
+  uint32_t start = millis();
+  uint8_t l = readline(adaptTimeout(commandText(command), timeout));
+  learnTimeout(commandText(command), start, timeout, l);
+
+  return l;
+}
+
+uint8_t TinySIM800::getReplyQuoted(ATCommand command, const __FlashStringHelper *suffix, uint16_t timeout)
+{
+  flushInput();
+
+  sendCommand(command);
+  mySerial.print('"');
+  mySerial.print(suffix);
+  mySerial.println('"');
+
+  uint32_t start = millis();
+  uint8_t l = readline(adaptTimeout(commandText(command), timeout));
+  learnTimeout(commandText(command), start, timeout, l);
 
   return l;
 }
@@ -693,7 +1958,9 @@ uint8_t TinySIM800::getReply(const __FlashStringHelper *prefix, char *suffix, ui
   mySerial.print(prefix);
   mySerial.println(suffix);
 
-  uint8_t l = readline(timeout);
+  uint32_t start = millis();
+  uint8_t l = readline(adaptTimeout(prefix, timeout));
+  learnTimeout(prefix, start, timeout, l);
 
   return l;
 }
@@ -706,7 +1973,9 @@ uint8_t TinySIM800::getReply(const __FlashStringHelper *prefix, int32_t suffix,
   mySerial.print(prefix);
   mySerial.println(suffix, DEC);
 
-  uint8_t l = readline(timeout);
+  uint32_t start = millis();
+  uint8_t l = readline(adaptTimeout(prefix, timeout));
+  learnTimeout(prefix, start, timeout, l);
 
   return l;
 }
@@ -721,7 +1990,9 @@ uint8_t TinySIM800::getReply(const __FlashStringHelper *prefix, int32_t suffix1,
   mySerial.print(',');
   mySerial.println(suffix2, DEC);
 
-  uint8_t l = readline(timeout);
+  uint32_t start = millis();
+  uint8_t l = readline(adaptTimeout(prefix, timeout));
+  learnTimeout(prefix, start, timeout, l);
 
   return l;
 }
@@ -736,7 +2007,9 @@ uint8_t TinySIM800::getReplyQuoted(const __FlashStringHelper *prefix, const __Fl
   mySerial.print(suffix);
   mySerial.println('"');
 
-  uint8_t l = readline(timeout);
+  uint32_t start = millis();
+  uint8_t l = readline(adaptTimeout(prefix, timeout));
+  learnTimeout(prefix, start, timeout, l);
 
   return l;
 }
@@ -801,6 +2074,38 @@ bool TinySIM800::sendCheckReplyQuoted(const __FlashStringHelper *prefix, const _
   return (prog_char_strcmp(replybuffer, (prog_char *)reply) == 0);
 }
 
+bool TinySIM800::sendCheckReply(char *send, ATReply reply, uint16_t timeout)
+{
+  if (!getReply(send, timeout))
+    return false;
+  return isReply(reply);
+}
+
+bool TinySIM800::sendCheckReply(ATCommand command, ATReply reply, uint16_t timeout)
+{
+  if (!getReply(command, timeout))
+    return false;
+  return isReply(reply);
+}
+
+bool TinySIM800::sendCheckReply(ATCommand command, int32_t suffix, ATReply reply, uint16_t timeout)
+{
+  getReply(command, suffix, timeout);
+  return isReply(reply);
+}
+
+bool TinySIM800::sendCheckReply(ATCommand command, int32_t suffix1, int32_t suffix2, ATReply reply, uint16_t timeout)
+{
+  getReply(command, suffix1, suffix2, timeout);
+  return isReply(reply);
+}
+
+bool TinySIM800::sendCheckReplyQuoted(ATCommand command, const __FlashStringHelper *suffix, ATReply reply, uint16_t timeout)
+{
+  getReplyQuoted(command, suffix, timeout);
+  return isReply(reply);
+}
+
 bool TinySIM800::parseReply(const __FlashStringHelper *toreply,
                             uint16_t *v, char divider, uint8_t index)
 {
@@ -841,7 +2146,7 @@ bool TinySIM800::parseReply(const __FlashStringHelper *toreply,
     p++;
   }
 
-  for (i = 0; i < strlen(p); i++)
+  for (i = 0; p[i] != 0; i++)
   {
     if (p[i] == divider)
       break;
@@ -878,7 +2183,7 @@ bool TinySIM800::parseReplyQuoted(const __FlashStringHelper *toreply,
   }
 
   // Copy characters from response field into result string.
-  for (i = 0, j = 0; j < maxlen && i < strlen(p); ++i)
+  for (i = 0, j = 0; j < maxlen && p[i] != 0; ++i)
   {
     // Stop if a divier is found.
     if (p[i] == divider)
@@ -909,3 +2214,16 @@ bool TinySIM800::sendParseReply(const __FlashStringHelper *tosend,
 
   return true;
 }
+
+bool TinySIM800::sendParseReply(ATCommand command, ATReply toreply,
+                                uint16_t *v, char divider, uint8_t index)
+{
+  getReply(command);
+
+  if (!parseReply(replyText(toreply), v, divider, index))
+    return false;
+
+  readline(); // eat 'OK'
+
+  return true;
+}
@@ -20,9 +20,16 @@
 #pragma once
 
 #include "Events.h"
+#include "Commands.h"
+#include "AdaptiveTimeout.h"
+#include "DNSCache.h"
+#include "Download.h"
+#include "PacedStream.h"
 #include <TinyDebug.h>
 
 #define FONA_DEFAULT_TIMEOUT_MS 500
+#define FONA_LINE_GAP_MS 50 // a started line is read on while bytes come this often
+#define FONA_TIME_SYNC_RETRY_MS 60000 // now() asks for the clock at most this often
 
 #define prog_char char PROGMEM
 
@@ -33,6 +40,49 @@
 #define prog_char_strcpy(to, fromprogmem) strcpy_P((to), (fromprogmem))
 //define prog_char_strncpy(to, from, len)		strncpy_P((to), (fromprogmem), (len))
 
+// How network operations (connectGPRS, TCPconnect, postHTTP) deal with
+// failure. Every step of an operation is tried up to attempts times, waiting
+// backoff ms (doubling up to maxBackoff, with jitter) in between, so an
+// operation continues from the step that failed. After breakerThreshold
+// failed operations in a row the circuit breaker opens and operations fail
+// immediately for breakerCooldown ms.
+struct RetryPolicy
+{
+        uint8_t attempts;         // per step, 1 = no retries
+        uint16_t backoff;         // ms
+        uint16_t maxBackoff;      // ms
+        uint8_t breakerThreshold; // 0 = no circuit breaker
+        uint32_t breakerCooldown; // ms
+};
+
+// Serving cell, as reported by AT+CENG
+struct ServingCell
+{
+        uint16_t arfcn;
+        uint8_t rxl; // receive level, 0..63
+        uint8_t rxq; // receive quality, 0..7 (lower is better)
+        uint16_t mcc;
+        uint16_t mnc;
+        uint16_t lac;
+        uint32_t cellId;
+        uint8_t ta; // timing advance
+};
+
+// GNSS fix (SIM808/SIM868), in fixed point
+struct GNSSFix : public EventArgs
+{
+        bool fixed;
+        uint32_t time;   // seconds since 1970-01-01 UTC
+        int32_t lat;     // 1e-6 degrees
+        int32_t lon;     // 1e-6 degrees
+        int32_t alt;     // 0.1 m above MSL
+        uint16_t speed;  // 0.01 km/h
+        uint16_t course; // 0.01 degrees
+        uint8_t hdop;    // 0.1
+        uint8_t satsInView;
+        uint8_t satsUsed;
+};
+
 class TinySIM800
 {
 public:
@@ -45,6 +95,7 @@ public:
         Event<EventFunc> timeout;
         Event<EventFunc> beforeHTTPConnect;
         Event<EventFunc> afterHTTPDisconnect;
+        Event<EventFunc> gnssFix; // EventArgs is the GNSSFix
 
 public:
         TinySIM800(Stream &);
@@ -54,6 +105,16 @@ public:
 
         // FONA 3G requirements
         bool setBaudrate(uint32_t baud);
+
+        // Flow control: AT+IFC=2,2 for RTS/CTS, and for boards without it in
+        // hardware, pin callbacks (cts returns true while the modem can take
+        // data, rts is asserted while the driver reads replies).
+        bool setFlowControl(bool rtscts);
+        void setFlowControlPins(bool (*cts)(), void (*rts)(bool));
+        // HTTP and TCP bodies are written in chunks of chunk bytes, pause ms apart
+        void setBodyPacing(uint16_t chunk, uint16_t pause = 0);
+        uint16_t getStalls() { return _paced.stalls(); }
+        uint32_t getStallTime() { return _paced.stallTime(); }
         void allowRoaming(bool);
 
         // RTC
@@ -67,9 +128,18 @@ public:
 
         bool sleepEnable(bool);
 
+        // Process pending unsolicited result codes without sending anything
+        void poll();
+
         // SIM query
         bool isRegistered();
+        bool isGPRSRegistered();
+        uint8_t getRegistrationStatus();
+        uint16_t getLAC();
+        uint32_t getCellId();
         uint8_t getRSSI();
+        bool getSignalQuality(uint8_t *rssi, uint8_t *ber);
+        bool getServingCell(ServingCell *cell);
         char *getIMEI();
         char *getVersion();
         char *getFirmware();
@@ -79,27 +149,54 @@ public:
         // Time
         bool enableNetworkTimeSync(bool onoff);
         char* getTime();
+        bool syncTime();
+        uint32_t now();
+        int8_t getTimeZone();
+
+        // GNSS (SIM808/SIM868)
+        bool enableGNSS(bool onoff);
+        bool getGNSSFix(GNSSFix *fix);
+        bool enableGNSSURC(uint8_t fixes);
+        const GNSSFix &lastGNSSFix() { poll(); return _gnssFix; }
 
         // GPRS handling
         bool isGPRSconnected();
         bool connectGPRS(const __FlashStringHelper *apn, const __FlashStringHelper *username = 0, const __FlashStringHelper *password = 0);
         bool disconnectGPRS();
 
+        // DNS, TCPconnect connects by cached IP address when a cache is set
+        bool resolve(const char *host, char *ip, uint8_t len);
+        void setDNSCache(DNSCache *dns);
+
         // TCP raw connections
         bool TCPconnect(char *server, uint16_t port);
         bool TCPclose();
         bool TCPconnected();
         bool TCPsend(char *packet, uint8_t len);
+        bool TCPsend(uint16_t (*ptrMeasurePacket)(), void (*ptrStreamPacket)(Stream &));
         uint16_t TCPavailable();
-        uint16_t TCPread(uint8_t *buff, uint8_t len);
+        uint16_t TCPread(uint8_t *buff, uint8_t len, uint16_t *left = NULL); // left: still in the modem
 
         // HTTP connect
         bool postHTTP(const char *, const char *,
                       uint16_t (*ptrMeasureBody)(),
-                      void (*ptrStreamBody)(const Stream&),
+                      void (*ptrStreamBody)(Stream &),
                       void (*ptrStatusCode)(const uint16_t),
                       void (*ptr)(char *) = NULL);
 
+        // Retries and circuit breaker for network operations
+        void setRetryPolicy(const RetryPolicy &policy);
+        uint16_t getRetryCount() { return _retries; }
+        uint16_t getBreakerTrips() { return _breakerTrips; }
+        bool isBreakerOpen() { return _breakerOpen; }
+
+        // Learn command timeouts from measured latencies (NULL to switch off)
+        void setAdaptiveTimeout(AdaptiveTimeout *adaptive);
+
+        // HTTP download, in ranges of segment bytes, straight into sink
+        bool downloadHTTP(const char *url, DownloadSink &sink, DownloadState &state,
+                          uint32_t segment = 32768, uint16_t chunk = 1024);
+
         // Helper functions to verify responses.
         bool expectReply(const __FlashStringHelper *reply, uint16_t timeout = 10000);
         bool sendCheckReply(char *send, char *reply, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
@@ -109,18 +206,100 @@ public:
 protected:
         bool _allowRoaming;
         uint8_t _type;
+        bool _engineeringMode;
+
+        // TCP: CIPMUX/CIPRXGET set up (since the last CIPSHUT), and socket open
+        bool _tcpConfigured;
+        bool _tcpOpen;
+        DNSCache *_dns;
+
+        // registration state, tracked from +CREG/+CGREG URCs
+        uint8_t _regStatus;
+        uint8_t _gprsRegStatus;
+        uint16_t _lac;
+        uint32_t _cellId;
+        bool _reportedRegistered; // as last reported by the events, in poll()
+
+        AdaptiveTimeout *_adaptive;
+
+        RetryPolicy _retryPolicy;
+        uint16_t _retries;
+        uint8_t _failures;
+        uint16_t _breakerTrips;
+        bool _breakerOpen;
+        uint32_t _breakerOpenedAt;
+
+        // network clock: _epoch (UTC) was the time at _epochMillis
+        bool _timeValid;
+        int8_t _timeZone;
+        uint32_t _epoch;
+        uint32_t _epochMillis;
+        uint32_t _lastSyncAttempt;
+        bool _syncAttempted;
+
+        GNSSFix _gnssFix;
+        bool _gnssFixPending; // a +UGNSINF came in, reported from poll()
+
+        PacedStream _paced;
+        bool (*_cts)();
+        void (*_rts)(bool);
 
         char replybuffer[255];
+        uint8_t _replyLen;
         const __FlashStringHelper *apn;
         const __FlashStringHelper *apnusername;
         const __FlashStringHelper *apnpassword;
-        const __FlashStringHelper *ok_reply;
+
+        bool isRegisteredStatus(uint8_t status);
+        bool refreshRegistration(bool gprs);
+        bool parseRegistration(bool gprs, bool solicited);
+        void updateRegistration(bool gprs, uint8_t status, uint16_t lac, uint32_t cellId);
+
+        uint16_t backoff(uint8_t attempt);
+        bool breakerAllows();
+        bool breakerRecord(bool success);
+
+        // Run step until it succeeds, as the retry policy allows.
+        template <typename Step>
+        bool retry(Step step)
+        {
+                for (uint8_t attempt = 1;; attempt++)
+                {
+                        if (step())
+                                return true;
+                        if (attempt >= _retryPolicy.attempts)
+                                return false;
+
+                        _retries++;
+                        delay(backoff(attempt));
+                }
+        }
+
+        void setClock(uint32_t epoch);
+        bool parseClock();
+        bool parseNetworkTime();
+        bool parseGNSS(const char *p, GNSSFix *fix);
+
+        bool TCPstart(char *server, uint16_t port);
+        bool lookupHost(const char *host, char *ip);
 
         bool initiateHTTP(const char *url, const char *headers = NULL);
         bool terminateHTTP();
+        bool downloadSegment(DownloadSink &sink, DownloadState &state, uint32_t segment, uint16_t chunk, bool *last);
+
+        uint16_t adaptTimeout(const __FlashStringHelper *command, uint16_t timeout);
+        void learnTimeout(const __FlashStringHelper *command, uint32_t start, uint16_t timeout, uint8_t replylen);
+
+        void sendCommand(ATCommand command);
+        bool isReply(ATReply reply);
+        bool isReplyPrefix(ATReply reply);
+        bool expectReply(ATReply reply, uint16_t timeout = 10000);
+        uint8_t awaitReply(ATReply reply, uint16_t timeout);
 
         void flushInput();
-        uint16_t readRaw(uint16_t b);
+        bool inputAvailable();
+        uint16_t readRaw(uint16_t b, uint16_t timeout = 1000);
+        bool expectPrompt(uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
         uint8_t readline(uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS, bool multiline = false);
         uint8_t getReply(char *send, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
         uint8_t getReply(const __FlashStringHelper *send, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
@@ -128,11 +307,20 @@ protected:
         uint8_t getReply(const __FlashStringHelper *prefix, int32_t suffix, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
         uint8_t getReply(const __FlashStringHelper *prefix, int32_t suffix1, int32_t suffix2, uint16_t timeout); // Don't set default value or else function call is ambiguous.
         uint8_t getReplyQuoted(const __FlashStringHelper *prefix, const __FlashStringHelper *suffix, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
+        uint8_t getReply(ATCommand command, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
+        uint8_t getReply(ATCommand command, int32_t suffix, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
+        uint8_t getReply(ATCommand command, int32_t suffix1, int32_t suffix2, uint16_t timeout);
+        uint8_t getReplyQuoted(ATCommand command, const __FlashStringHelper *suffix, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
 
         bool sendCheckReply(const __FlashStringHelper *prefix, char *suffix, const __FlashStringHelper *reply, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
         bool sendCheckReply(const __FlashStringHelper *prefix, int32_t suffix, const __FlashStringHelper *reply, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
         bool sendCheckReply(const __FlashStringHelper *prefix, int32_t suffix, int32_t suffix2, const __FlashStringHelper *reply, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
         bool sendCheckReplyQuoted(const __FlashStringHelper *prefix, const __FlashStringHelper *suffix, const __FlashStringHelper *reply, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
+        bool sendCheckReply(char *send, ATReply reply, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
+        bool sendCheckReply(ATCommand command, ATReply reply, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
+        bool sendCheckReply(ATCommand command, int32_t suffix, ATReply reply, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
+        bool sendCheckReply(ATCommand command, int32_t suffix1, int32_t suffix2, ATReply reply, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
+        bool sendCheckReplyQuoted(ATCommand command, const __FlashStringHelper *suffix, ATReply reply, uint16_t timeout = FONA_DEFAULT_TIMEOUT_MS);
 
         bool parseReply(const __FlashStringHelper *toreply,
                            uint16_t *v, char divider = ',', uint8_t index = 0);
@@ -144,6 +332,8 @@ protected:
         bool sendParseReply(const __FlashStringHelper *tosend,
                                const __FlashStringHelper *toreply,
                                uint16_t *v, char divider = ',', uint8_t index = 0);
+        bool sendParseReply(ATCommand command, ATReply toreply,
+                               uint16_t *v, char divider = ',', uint8_t index = 0);
 
 private:
         Stream &mySerial;
@@ -0,0 +1,233 @@
+#include "TraceStream.h"
+
+static const char traceSignature[] = "SIMT";
+
+RecordingStream::RecordingStream(Stream &port, Print &trace)
+    : _port(port), _trace(trace)
+{
+  _len = 0;
+  _fromModem = false;
+  _recordTime = 0;
+  _lastByteTime = 0;
+  _lastRecordTime = 0;
+}
+
+void RecordingStream::begin()
+{
+  _trace.write((const uint8_t *)traceSignature, 4);
+  _trace.write((uint8_t)TRACE_VERSION);
+
+  _len = 0;
+  _lastRecordTime = millis();
+}
+
+void RecordingStream::end()
+{
+  writeRecord();
+  _trace.flush();
+}
+
+int RecordingStream::available()
+{
+  return _port.available();
+}
+
+int RecordingStream::read()
+{
+  int c = _port.read();
+  if (c >= 0)
+    append(true, c);
+
+  return c;
+}
+
+int RecordingStream::peek()
+{
+  return _port.peek();
+}
+
+size_t RecordingStream::write(uint8_t b)
+{
+  append(false, b);
+
+  return _port.write(b);
+}
+
+void RecordingStream::flush()
+{
+  _port.flush();
+}
+
+void RecordingStream::append(bool fromModem, uint8_t b)
+{
+  uint32_t now = millis();
+
+  if (_len > 0 && (fromModem != _fromModem || _len == sizeof(_buffer) || now - _lastByteTime > TRACE_GAP_MS))
+    writeRecord();
+
+  if (_len == 0)
+  {
+    _fromModem = fromModem;
+    _recordTime = now;
+  }
+
+  _buffer[_len++] = b;
+  _lastByteTime = now;
+}
+
+void RecordingStream::writeRecord()
+{
+  if (_len == 0)
+    return;
+
+  _trace.write((uint8_t)((_fromModem ? 0x80 : 0x00) | (_len - 1)));
+
+  uint32_t delta = _recordTime - _lastRecordTime;
+  do
+  {
+    uint8_t b = delta & 0x7F;
+    delta >>= 7;
+    if (delta > 0)
+      b |= 0x80;
+    _trace.write(b);
+  } while (delta > 0);
+
+  _trace.write(_buffer, _len);
+
+  _lastRecordTime = _recordTime;
+  _len = 0;
+}
+
+ReplayStream::ReplayStream(Stream &trace, bool realTime)
+    : _trace(trace), _realTime(realTime)
+{
+  _fromModem = false;
+  _remaining = 0;
+  _due = 0;
+  _start = 0;
+  _peeked = -1;
+  _mismatches = 0;
+}
+
+bool ReplayStream::begin()
+{
+  for (uint8_t i = 0; i < 4; i++)
+    if (_trace.read() != traceSignature[i])
+      return false;
+  if (_trace.read() != TRACE_VERSION)
+    return false;
+
+  _remaining = 0;
+  _due = 0;
+  _peeked = -1;
+  _mismatches = 0;
+  _start = millis();
+
+  return nextRecord();
+}
+
+bool ReplayStream::finished()
+{
+  return _remaining == 0 && !nextRecord();
+}
+
+bool ReplayStream::nextRecord()
+{
+  if (_remaining > 0)
+    return true;
+
+  int flags = _trace.read();
+  if (flags < 0)
+    return false;
+
+  uint32_t delta = 0;
+  uint8_t shift = 0;
+  int b;
+  do
+  {
+    b = _trace.read();
+    if (b < 0)
+      return false;
+    delta |= (uint32_t)(b & 0x7F) << shift;
+    shift += 7;
+  } while (b & 0x80);
+
+  _fromModem = flags & 0x80;
+  _remaining = (flags & 0x7F) + 1;
+  _due += delta;
+
+  return true;
+}
+
+// Is the next modem byte due? Records written by the driver are skipped in
+// real time mode, and waited for otherwise.
+bool ReplayStream::ready()
+{
+  while (nextRecord())
+  {
+    if (_fromModem)
+      return !_realTime || millis() - _start >= _due;
+
+    if (!_realTime)
+      return false;
+
+    // real time: the driver's own bytes are not replayed
+    while (_remaining > 0)
+    {
+      _trace.read();
+      _remaining--;
+    }
+  }
+
+  return false;
+}
+
+int ReplayStream::available()
+{
+  if (_peeked >= 0)
+    return 1;
+
+  return ready() ? _remaining : 0;
+}
+
+int ReplayStream::read()
+{
+  if (_peeked >= 0)
+  {
+    int c = _peeked;
+    _peeked = -1;
+    return c;
+  }
+
+  if (!ready())
+    return -1;
+
+  _remaining--;
+  return _trace.read();
+}
+
+int ReplayStream::peek()
+{
+  if (_peeked < 0)
+    _peeked = read();
+
+  return _peeked;
+}
+
+size_t ReplayStream::write(uint8_t b)
+{
+  if (_realTime)
+    return 1;
+
+  // the driver catches up with the trace
+  if (nextRecord() && !_fromModem)
+  {
+    if (_trace.read() != b)
+      _mismatches++;
+    _remaining--;
+  }
+  else
+    _mismatches++;
+
+  return 1;
+}
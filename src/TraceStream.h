@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Serial traces of the modem link, for reproducing field problems.
+//
+// A trace starts with the 4 byte signature "SIMT" and a version byte,
+// followed by records:
+//
+//   flags   bit 7: direction (1 = from the modem, 0 = to the modem)
+//           bits 0-6: length - 1
+//   delta   milliseconds since the previous record, as a LEB128 varint
+//   data    length bytes
+//
+// Consecutive bytes in the same direction are collected into one record
+// until the direction changes, the record is full or the line is idle for
+// TRACE_GAP_MS.
+//
+// Times are taken when the driver reads a byte, not when it arrived at the
+// UART: the deltas show the modem as the driver saw it, including the
+// driver's own delays, and a real time replay reproduces that timing.
+
+#define TRACE_VERSION 1
+#define TRACE_MAX_RECORD 128
+#define TRACE_GAP_MS 5
+
+// Sits between the driver and the port, and writes everything going over
+// it to trace (an SD card file, ...):
+//
+//   RecordingStream recorder(SerialAT, traceFile);
+//   TinySIM800 modem(recorder);
+class RecordingStream : public Stream
+{
+public:
+        RecordingStream(Stream &port, Print &trace);
+
+        void begin();
+        void end();
+
+        int available();
+        int read();
+        int peek();
+        size_t write(uint8_t b);
+        void flush();
+
+protected:
+        Stream &_port;
+        Print &_trace;
+
+        uint8_t _buffer[TRACE_MAX_RECORD];
+        uint8_t _len;
+        bool _fromModem;
+        uint32_t _recordTime;
+        uint32_t _lastByteTime;
+        uint32_t _lastRecordTime;
+
+        void append(bool fromModem, uint8_t b);
+        void writeRecord();
+};
+
+// Plays a recorded trace back to the driver in place of the port. In real
+// time mode the modem's bytes become available at their recorded moment.
+// Otherwise they are released as soon as the driver has written everything
+// that preceded them in the trace, so replies never arrive before the
+// command they belong to.
+class ReplayStream : public Stream
+{
+public:
+        ReplayStream(Stream &trace, bool realTime = false);
+
+        bool begin();
+        bool finished();
+
+        int available();
+        int read();
+        int peek();
+        size_t write(uint8_t b);
+
+        // bytes the driver wrote that differ from the recorded ones
+        uint32_t mismatches() const { return _mismatches; }
+
+protected:
+        Stream &_trace;
+        bool _realTime;
+
+        bool _fromModem;
+        uint8_t _remaining; // bytes left in the current record
+        uint32_t _due;      // time of the current record, relative to begin()
+        uint32_t _start;
+        int16_t _peeked;
+        uint32_t _mismatches;
+
+        bool nextRecord();
+        bool ready();
+};
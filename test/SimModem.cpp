@@ -0,0 +1,272 @@
+#include "SimModem.h"
+
+int checkFailures = 0;
+
+int checkResult(const char *name)
+{
+  if (checkFailures == 0)
+    printf("%s: OK\n", name);
+  else
+    printf("%s: %d failure(s)\n", name, checkFailures);
+
+  return checkFailures == 0 ? 0 : 1;
+}
+
+SimModem::SimModem()
+{
+  tcpOpen = false;
+  server = NULL;
+  holdOnRts = false;
+  rtsAsserted = false;
+  ctsAsserted = true;
+  _dataMode = NoData;
+  _dataLeft = 0;
+  msPerByte = 0;
+  _nextByte = 0;
+  httpLinkUp = true;
+  httpDropAfter = 0;
+  _httpBreak = 0;
+  _httpBreakEnd = 0;
+  _httpRead = 0;
+}
+
+int SimModem::available()
+{
+  if (holdOnRts && !rtsAsserted)
+    return 0;
+  if (msPerByte > 0)
+    return (int32_t)(millis() - _nextByte) >= 0 && !toDriver.empty() ? 1 : 0;
+
+  return toDriver.size();
+}
+
+int SimModem::read()
+{
+  if (available() == 0)
+    return -1;
+
+  uint8_t c = toDriver[0];
+  toDriver.erase(0, 1);
+  _nextByte = millis() + msPerByte;
+  return c;
+}
+
+int SimModem::peek()
+{
+  if (available() == 0)
+    return -1;
+
+  return (uint8_t)toDriver[0];
+}
+
+size_t SimModem::write(uint8_t b)
+{
+  if (_dataMode == CipsendData && b == 0x1B)
+  {
+    // ESC: send cancelled
+    _dataMode = NoData;
+    _dataLeft = 0;
+    return 1;
+  }
+  if (_dataMode != NoData)
+  {
+    _block += (char)b;
+    if (--_dataLeft == 0)
+    {
+      if (_dataMode == CipsendData)
+      {
+        fromClient += _block;
+        send("\r\nSEND OK\r\n");
+        if (server)
+          server(*this, _block);
+      }
+      else
+      {
+        httpBody = _block;
+        send("\r\nOK\r\n");
+      }
+      _dataMode = NoData;
+    }
+    return 1;
+  }
+
+  if (b == '\r')
+    return 1;
+  if (b != '\n')
+  {
+    _line += (char)b;
+    return 1;
+  }
+
+  if (!_line.empty())
+    command(_line);
+  _line.clear();
+
+  return 1;
+}
+
+void SimModem::reply(const char *prefix, const char *response)
+{
+  _replies[prefix] = response;
+}
+
+void SimModem::urc(const char *line)
+{
+  send(std::string("\r\n") + line + "\r\n");
+}
+
+uint32_t SimModem::count(const char *prefix) const
+{
+  uint32_t n = 0;
+  for (size_t i = 0; i < commands.size(); i++)
+    if (commands[i].compare(0, strlen(prefix), prefix) == 0)
+      n++;
+  return n;
+}
+
+static bool startsWith(const std::string &s, const char *prefix)
+{
+  return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+void SimModem::command(const std::string &line)
+{
+  commands.push_back(line);
+
+  // canned replies, longest prefix first
+  std::string match;
+  for (std::map<std::string, std::string>::iterator i = _replies.begin(); i != _replies.end(); ++i)
+    if (startsWith(line, i->first.c_str()) && i->first.size() >= match.size())
+      match = i->first;
+  if (!match.empty())
+  {
+    send(_replies[match]);
+    return;
+  }
+
+  char buffer[64];
+
+  if (startsWith(line, "AT+CIPSEND="))
+  {
+    _dataLeft = atoi(line.c_str() + 11);
+    if (_dataLeft > 0)
+    {
+      _dataMode = CipsendData;
+      _block.clear();
+      send("> ");
+    }
+    else
+      send("\r\nERROR\r\n");
+  }
+  else if (startsWith(line, "AT+HTTPDATA="))
+  {
+    _dataLeft = atoi(line.c_str() + 12);
+    if (_dataLeft > 0)
+    {
+      _dataMode = HttpData;
+      _block.clear();
+      send("\r\nDOWNLOAD\r\n");
+    }
+    else
+      send("\r\nERROR\r\n");
+  }
+  else if (line == "AT+CIPRXGET=4")
+  {
+    snprintf(buffer, sizeof(buffer), "\r\n+CIPRXGET: 4,%u\r\n\r\nOK\r\n", (unsigned)toClient.size());
+    send(buffer);
+  }
+  else if (startsWith(line, "AT+CIPRXGET=2,"))
+  {
+    size_t n = atoi(line.c_str() + 14);
+    if (n > toClient.size())
+      n = toClient.size();
+    if (n > 1460)
+      n = 1460;
+    snprintf(buffer, sizeof(buffer), "\r\n+CIPRXGET: 2,%u,%u\r\n", (unsigned)n, (unsigned)(toClient.size() - n));
+    send(buffer);
+    send(toClient.substr(0, n));
+    toClient.erase(0, n);
+    send("\r\nOK\r\n");
+  }
+  else if (startsWith(line, "AT+HTTPPARA=\"BREAK\","))
+  {
+    _httpBreak = strtoul(line.c_str() + 20, NULL, 10);
+    send("\r\nOK\r\n");
+  }
+  else if (startsWith(line, "AT+HTTPPARA=\"BREAKEND\","))
+  {
+    _httpBreakEnd = strtoul(line.c_str() + 23, NULL, 10);
+    send("\r\nOK\r\n");
+  }
+  else if (line == "AT+HTTPACTION=0")
+  {
+    uint16_t status = 200;
+    _httpResponse.clear();
+    if (!httpLinkUp)
+      status = 601;
+    else if (_httpBreak >= httpFile.size() && (_httpBreak > 0 || _httpBreakEnd > 0))
+      status = 416;
+    else if (_httpBreak > 0 || _httpBreakEnd > 0)
+    {
+      status = 206;
+      size_t end = _httpBreakEnd > 0 && _httpBreakEnd < httpFile.size() ? _httpBreakEnd + 1 : httpFile.size();
+      _httpResponse = httpFile.substr(_httpBreak, end - _httpBreak);
+    }
+    else
+      _httpResponse = httpFile;
+
+    snprintf(buffer, sizeof(buffer), "\r\nOK\r\n\r\n+HTTPACTION: 0,%u,%u\r\n", status, (unsigned)_httpResponse.size());
+    send(buffer);
+  }
+  else if (startsWith(line, "AT+HTTPREAD="))
+  {
+    size_t pos = atoi(line.c_str() + 12);
+    size_t n = atoi(line.c_str() + line.find(',') + 1);
+    if (pos > _httpResponse.size())
+      pos = _httpResponse.size();
+    if (n > _httpResponse.size() - pos)
+      n = _httpResponse.size() - pos;
+
+    snprintf(buffer, sizeof(buffer), "\r\n+HTTPREAD: %u\r\n", (unsigned)n);
+    send(buffer);
+    if (httpDropAfter > 0 && _httpRead + n > httpDropAfter)
+    {
+      // the link goes, with the data partly sent
+      send(_httpResponse.substr(pos, httpDropAfter - _httpRead));
+      _httpRead = httpDropAfter;
+      httpDropAfter = 0;
+      httpLinkUp = false;
+      return;
+    }
+    send(_httpResponse.substr(pos, n));
+    _httpRead += n;
+    send("\r\nOK\r\n");
+  }
+  else if (line == "AT+HTTPTERM")
+  {
+    _httpBreak = 0;
+    _httpBreakEnd = 0;
+    send("\r\nOK\r\n");
+  }
+  else if (startsWith(line, "AT+CIPSTART="))
+  {
+    tcpOpen = true;
+    send("\r\nOK\r\n\r\nCONNECT OK\r\n");
+  }
+  else if (line == "AT+CIPCLOSE")
+  {
+    tcpOpen = false;
+    send("\r\nCLOSE OK\r\n");
+  }
+  else if (line == "AT+CIPSHUT")
+  {
+    tcpOpen = false;
+    send("\r\nSHUT OK\r\n");
+  }
+  else if (line == "AT+CIPSTATUS")
+  {
+    send(tcpOpen ? "\r\nOK\r\n\r\nSTATE: CONNECT OK\r\n" : "\r\nOK\r\n\r\nSTATE: TCP CLOSED\r\n");
+  }
+  else
+    send("\r\nOK\r\n");
+}
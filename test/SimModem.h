@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <Arduino.h>
+
+// Simulated SIM800 on the other end of the driver's Stream. It answers the
+// AT commands the driver uses (plain OK by default, canned replies set with
+// reply()), runs the CIPSEND and HTTPDATA data modes, and has one TCP
+// socket whose far end is a server function that gets every sent block
+// and can queue bytes for the client (read back with AT+CIPRXGET), and an
+// HTTP GET of one file.
+//
+// Flow control: with holdOnRts the modem keeps its output while the driver
+// deasserts RTS (rts(false)), as it does after AT+IFC=2,2; cts() reports
+// whether it takes data.
+class SimModem : public Stream
+{
+public:
+        SimModem();
+
+        int available();
+        int read();
+        int peek();
+        size_t write(uint8_t b);
+
+        // reply to commands starting with prefix (instead of the default)
+        void reply(const char *prefix, const char *response);
+        void clearReply(const char *prefix) { _replies.erase(prefix); }
+        // unsolicited, sent to the driver right away
+        void urc(const char *line);
+        void feed(const std::string &raw) { toDriver += raw; }
+
+        // every command line the driver sent, without CR/LF
+        std::vector<std::string> commands;
+        uint32_t count(const char *prefix) const;
+
+        // TCP socket
+        bool tcpOpen;
+        std::string toClient;   // waiting to be read with AT+CIPRXGET
+        std::string fromClient; // everything sent with AT+CIPSEND
+        void (*server)(SimModem &sim, const std::string &block);
+
+        // the HTTPDATA body
+        std::string httpBody;
+
+        // the file behind AT+HTTPACTION=0, read back with AT+HTTPREAD; a
+        // range when BREAK/BREAKEND are set
+        std::string httpFile;
+        // while the link is down HTTPACTION fails with 601; it goes down by
+        // itself after httpDropAfter bytes read (0: never), partway through
+        // an HTTPREAD
+        bool httpLinkUp;
+        uint32_t httpDropAfter;
+
+        // flow control
+        bool holdOnRts;
+        bool rtsAsserted;
+        bool ctsAsserted;
+
+        // bytes the driver wrote while the modem was in a data mode
+        bool inDataMode() const { return _dataLeft > 0; }
+
+        std::string toDriver;
+        // one byte every msPerByte ms to the driver (0: all at once), a slow line
+        uint8_t msPerByte;
+
+protected:
+        uint32_t _nextByte;
+        std::string _line;
+        std::map<std::string, std::string> _replies;
+
+        enum
+        {
+                NoData,
+                CipsendData,
+                HttpData
+        };
+        uint8_t _dataMode;
+        uint32_t _dataLeft;
+        std::string _block;
+
+        uint32_t _httpBreak;
+        uint32_t _httpBreakEnd; // 0: to the end
+        std::string _httpResponse;
+        uint32_t _httpRead;
+
+        void command(const std::string &line);
+        void send(const std::string &s) { toDriver += s; }
+};
+
+// Assertions for the host tests: failures are counted and reported, the
+// test goes on.
+extern int checkFailures;
+
+#define CHECK(cond)                                                           \
+        do                                                                    \
+        {                                                                     \
+                if (!(cond))                                                  \
+                {                                                             \
+                        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+                        checkFailures++;                                      \
+                }                                                             \
+        } while (0)
+
+int checkResult(const char *name);
@@ -0,0 +1,281 @@
+// Encode throughput and body size of a GPS track as JSON text, as CBOR with
+// the same keys (CborWriter) and as a delta-encoded TrackEncoder array.
+// Checks the encoder against RFC 8949 encodings first.
+
+#include <chrono>
+#include <string>
+
+#include "CborWriter.h"
+
+// Counts what is written.
+class Sink : public Print
+{
+public:
+  Sink() : bytes(0) {}
+
+  size_t write(uint8_t)
+  {
+    bytes++;
+    return 1;
+  }
+
+  uint64_t bytes;
+};
+
+// Keeps what is written.
+class Capture : public Print
+{
+public:
+  size_t write(uint8_t b)
+  {
+    bytes += (char)b;
+    return 1;
+  }
+
+  std::string bytes;
+};
+
+static int failures;
+
+static std::string hex(const std::string &bytes)
+{
+  std::string s;
+  char h[3];
+  for (size_t i = 0; i < bytes.size(); i++)
+  {
+    snprintf(h, sizeof(h), "%02x", (uint8_t)bytes[i]);
+    s += h;
+  }
+  return s;
+}
+
+// Encodings from RFC 8949 appendix A (floats in single precision, which is
+// what writeFloat always uses).
+struct Encoding
+{
+  const char *hex;
+  void (*encode)(CborWriter &cbor);
+};
+
+static const Encoding encodings[] = {
+    // unsigned integers, at every head size
+    {"00", [](CborWriter &c) { c.writeUInt(0); }},
+    {"17", [](CborWriter &c) { c.writeUInt(23); }},
+    {"1818", [](CborWriter &c) { c.writeUInt(24); }},
+    {"1864", [](CborWriter &c) { c.writeUInt(100); }},
+    {"18ff", [](CborWriter &c) { c.writeUInt(255); }},
+    {"190100", [](CborWriter &c) { c.writeUInt(256); }},
+    {"1903e8", [](CborWriter &c) { c.writeUInt(1000); }},
+    {"19ffff", [](CborWriter &c) { c.writeUInt(65535); }},
+    {"1a00010000", [](CborWriter &c) { c.writeUInt(65536); }},
+    {"1a000f4240", [](CborWriter &c) { c.writeUInt(1000000); }},
+    {"1affffffff", [](CborWriter &c) { c.writeUInt(0xFFFFFFFF); }},
+    // negative integers are -1 - n
+    {"0a", [](CborWriter &c) { c.writeInt(10); }},
+    {"20", [](CborWriter &c) { c.writeInt(-1); }},
+    {"29", [](CborWriter &c) { c.writeInt(-10); }},
+    {"37", [](CborWriter &c) { c.writeInt(-24); }},
+    {"3818", [](CborWriter &c) { c.writeInt(-25); }},
+    {"3863", [](CborWriter &c) { c.writeInt(-100); }},
+    {"3903e7", [](CborWriter &c) { c.writeInt(-1000); }},
+    {"3a7fffffff", [](CborWriter &c) { c.writeInt(-2147483647 - 1); }},
+    // floats
+    {"fa47c35000", [](CborWriter &c) { c.writeFloat(100000.0f); }},
+    {"fa7f7fffff", [](CborWriter &c) { c.writeFloat(3.4028234663852886e+38f); }},
+    {"fac0800000", [](CborWriter &c) { c.writeFloat(-4.0f); }},
+    // simple values
+    {"f4", [](CborWriter &c) { c.writeBool(false); }},
+    {"f5", [](CborWriter &c) { c.writeBool(true); }},
+    {"f6", [](CborWriter &c) { c.writeNull(); }},
+    // strings
+    {"60", [](CborWriter &c) { c.writeString(""); }},
+    {"6449455446", [](CborWriter &c) { c.writeString("IETF"); }},
+    {"6449455446", [](CborWriter &c) { c.writeString(F("IETF")); }},
+    {"4401020304", [](CborWriter &c) {
+       static const uint8_t b[] = {1, 2, 3, 4};
+       c.writeBytes(b, sizeof(b));
+     }},
+    // arrays and maps
+    {"80", [](CborWriter &c) { c.beginArray(0); }},
+    {"83010203", [](CborWriter &c) {
+       c.beginArray(3);
+       c.writeUInt(1);
+       c.writeUInt(2);
+       c.writeUInt(3);
+     }},
+    {"9819", [](CborWriter &c) { c.beginArray(25); }},
+    {"a201020304", [](CborWriter &c) {
+       c.beginMap(2);
+       c.writeUInt(1);
+       c.writeUInt(2);
+       c.writeUInt(3);
+       c.writeUInt(4);
+     }},
+    {"9f018202039f0405ffff", [](CborWriter &c) {
+       c.beginArray();
+       c.writeUInt(1);
+       c.beginArray(2);
+       c.writeUInt(2);
+       c.writeUInt(3);
+       c.beginArray();
+       c.writeUInt(4);
+       c.writeUInt(5);
+       c.end();
+       c.end();
+     }},
+    {"bf61610161629f0203ffff", [](CborWriter &c) {
+       c.beginMap();
+       c.writeString("a");
+       c.writeUInt(1);
+       c.writeString("b");
+       c.beginArray();
+       c.writeUInt(2);
+       c.writeUInt(3);
+       c.end();
+       c.end();
+     }},
+};
+
+static void verifyEncodings()
+{
+  for (size_t i = 0; i < sizeof(encodings) / sizeof(encodings[0]); i++)
+  {
+    Capture capture;
+    CborWriter cbor(capture);
+    encodings[i].encode(cbor);
+
+    ByteCounter counter;
+    CborWriter counted(counter);
+    encodings[i].encode(counted);
+
+    if (hex(capture.bytes) != encodings[i].hex || counter.count() != capture.bytes.size())
+    {
+      printf("CBOR: expected %s, got %s (counted %u)\n", encodings[i].hex,
+             hex(capture.bytes).c_str(), counter.count());
+      failures++;
+    }
+  }
+}
+
+struct Point
+{
+  uint32_t time;
+  int32_t lat; // 1e-6 degrees
+  int32_t lon;
+  int16_t alt; // meters
+};
+
+static void writeJson(Print &out, const Point *points, uint16_t n)
+{
+  out.print('[');
+  for (uint16_t i = 0; i < n; i++)
+  {
+    if (i)
+      out.print(',');
+    out.print(F("{\"time\":"));
+    out.print((unsigned long)points[i].time);
+    out.print(F(",\"lat\":"));
+    out.print(points[i].lat / 1e6, 6);
+    out.print(F(",\"lon\":"));
+    out.print(points[i].lon / 1e6, 6);
+    out.print(F(",\"alt\":"));
+    out.print(points[i].alt);
+    out.print('}');
+  }
+  out.print(']');
+}
+
+static void writeCbor(Print &out, const Point *points, uint16_t n)
+{
+  CborWriter cbor(out);
+  cbor.beginArray(n);
+  for (uint16_t i = 0; i < n; i++)
+  {
+    cbor.beginMap(4);
+    cbor.writeString(F("time"));
+    cbor.writeUInt(points[i].time);
+    cbor.writeString(F("lat"));
+    cbor.writeInt(points[i].lat);
+    cbor.writeString(F("lon"));
+    cbor.writeInt(points[i].lon);
+    cbor.writeString(F("alt"));
+    cbor.writeInt(points[i].alt);
+  }
+}
+
+static void writeTrack(Print &out, const Point *points, uint16_t n)
+{
+  TrackEncoder track(out);
+  track.begin();
+  for (uint16_t i = 0; i < n; i++)
+    track.add(points[i].time, points[i].lat, points[i].lon, points[i].alt);
+  track.end();
+}
+
+// ByteCounter agrees with what is actually written, bulk writes included.
+static void verifyCount(const char *name, void (*encode)(Print &, const Point *, uint16_t),
+                        const Point *points, uint16_t n)
+{
+  Sink sink;
+  encode(sink, points, n);
+  ByteCounter counter;
+  encode(counter, points, n);
+
+  if (counter.count() != sink.bytes)
+  {
+    printf("%s: ByteCounter says %u, %lu written\n", name, counter.count(), (unsigned long)sink.bytes);
+    failures++;
+  }
+}
+
+static uint64_t jsonBytes;
+
+static void run(const char *name, void (*encode)(Print &, const Point *, uint16_t),
+                const Point *points, uint16_t n, long rounds)
+{
+  Sink sink;
+  auto start = std::chrono::steady_clock::now();
+  for (long r = 0; r < rounds; r++)
+    encode(sink, points, n);
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  uint64_t bytes = sink.bytes / rounds;
+  if (!jsonBytes)
+    jsonBytes = bytes;
+
+  printf("%-14s %6.1f bytes/point %5.1f%% of JSON %8.1f MB/s %10.0f points/s\n",
+         name, (double)bytes / n, 100.0 * bytes / jsonBytes,
+         sink.bytes / s / 1e6, n * rounds / s);
+}
+
+int main()
+{
+  // a drive, one fix per second
+  const uint16_t n = 600;
+  static Point points[n];
+
+  srand(1);
+  Point p = {1615725005, 52520008, 13404954, 34};
+  for (uint16_t i = 0; i < n; i++)
+  {
+    points[i] = p;
+    p.time += 1;
+    p.lat += rand() % 201 - 100;
+    p.lon += rand() % 301 - 150;
+    p.alt += rand() % 5 - 2;
+  }
+
+  verifyEncodings();
+  verifyCount("JSON", writeJson, points, n);
+  verifyCount("CborWriter", writeCbor, points, n);
+  verifyCount("TrackEncoder", writeTrack, points, n);
+  if (failures)
+    return 1;
+
+  const long rounds = 2000;
+  run("JSON", writeJson, points, n, rounds);
+  run("CborWriter", writeCbor, points, n, rounds);
+  run("TrackEncoder", writeTrack, points, n, rounds);
+
+  return 0;
+}
@@ -0,0 +1,135 @@
+// Lines per second through readline (replies and URCs), parseReply,
+// getTime and sendUSSD, on the host. Wall-clock time; the driver's own
+// millis() timeouts run on the virtual clock.
+
+#include <chrono>
+#include <string>
+
+#include "TinySIM800.h"
+
+// Serves input; every command line written makes reply available, like a
+// modem answering.
+class BenchStream : public Stream
+{
+public:
+        BenchStream() : _pos(0) {}
+
+        void load(const std::string &input)
+        {
+                _input = input;
+                _pos = 0;
+        }
+
+        std::string reply;
+
+        int available() { return _input.size() - _pos; }
+        int read() { return _pos < _input.size() ? (uint8_t)_input[_pos++] : -1; }
+        int peek() { return _pos < _input.size() ? (uint8_t)_input[_pos] : -1; }
+        size_t write(uint8_t b)
+        {
+                if (b == '\n' && !reply.empty())
+                        load(reply);
+                return 1;
+        }
+
+protected:
+        std::string _input;
+        size_t _pos;
+};
+
+class BenchProbe : public TinySIM800
+{
+public:
+        BenchProbe(Stream &port) : TinySIM800(port) {}
+
+        using TinySIM800::readline;
+        using TinySIM800::parseReply;
+};
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char *name, long lines, double s)
+{
+  printf("%-24s %10.0f lines/s\n", name, lines / s);
+}
+
+static void readlines(const char *name, const char *line, long lines)
+{
+  BenchStream stream;
+  BenchProbe modem(stream);
+
+  std::string input;
+  for (long i = 0; i < lines; i++)
+    input += line;
+  stream.load(input);
+
+  auto start = std::chrono::steady_clock::now();
+  while (stream.available())
+    modem.readline(0xFFFF);
+  report(name, lines, seconds(start));
+}
+
+int main()
+{
+  const long lines = 200000;
+
+  readlines("readline reply", "\r\nOK\r\n", lines);
+  readlines("readline +CREG URC", "\r\n+CREG: 1,\"1A2B\",\"00FF\"\r\n", lines);
+  readlines("readline *PSUTTZ URC", "\r\n*PSUTTZ: 2021,3,14,12,30,5,\"+4\",0\r\n", lines);
+  readlines("readline long line", "\r\n+CENG: 0,\"0021,35,00,206,01,36,0c51,04,00,2b0c,255\"\r\n", lines);
+
+  {
+    BenchStream stream;
+    BenchProbe modem(stream);
+    std::string input;
+    for (long i = 0; i < lines; i++)
+      input += "\r\n+CSQ: 17,0\r\n";
+    stream.load(input);
+
+    uint16_t rssi, ber;
+    auto start = std::chrono::steady_clock::now();
+    while (stream.available())
+    {
+      modem.readline(0xFFFF);
+      modem.parseReply(F("+CSQ: "), &rssi, ',', 0);
+      modem.parseReply(F("+CSQ: "), &ber, ',', 1);
+    }
+    report("readline + parseReply", lines, seconds(start));
+  }
+
+  // these go through a whole command: flushInput, send, reply, OK
+  const long commands = 20000;
+  {
+    BenchStream stream;
+    BenchProbe modem(stream);
+    stream.reply = "\r\n+CCLK: \"21/03/14,12:30:05+04\"\r\n\r\nOK\r\n";
+
+    long parsed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < commands; i++)
+      parsed += modem.getTime() != 0;
+    report("getTime", commands * 2, seconds(start));
+    if (parsed != commands)
+      printf("getTime: only %ld of %ld parsed\n", parsed, commands);
+  }
+  {
+    BenchStream stream;
+    BenchProbe modem(stream);
+    stream.reply = "\r\nOK\r\n\r\n+CUSD: 0,\"Your balance is 12.34 EUR\",15\r\n";
+
+    char balance[32];
+    uint16_t len;
+    auto start = std::chrono::steady_clock::now();
+    long parsed = 0;
+    for (long i = 0; i < commands; i++)
+      parsed += modem.sendUSSD((char *)"*101#", balance, sizeof(balance), &len);
+    report("sendUSSD", commands * 3, seconds(start));
+    if (parsed != commands)
+      printf("sendUSSD: only %ld of %ld parsed\n", parsed, commands);
+  }
+
+  return 0;
+}
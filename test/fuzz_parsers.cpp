@@ -0,0 +1,140 @@
+// Fuzzes the reply parsers with arbitrary modem output. The first input byte
+// picks the entry point, the rest is what the modem sends.
+//
+// Built by the Makefile with ASan/UBSan as a standalone program that feeds
+// random mixes of reply fragments and noise (fuzz_parsers [iterations]
+// [seed]); with clang, `make fuzz-libfuzzer` builds the same entry point
+// for libFuzzer.
+
+#include <string>
+
+#include "TinySIM800.h"
+
+// The modem side: serves the input, swallows what the driver sends.
+class FuzzStream : public Stream
+{
+public:
+        FuzzStream(const uint8_t *data, size_t size) : _data(data), _size(size), _pos(0) {}
+
+        int available() { return _size - _pos; }
+        int read() { return _pos < _size ? _data[_pos++] : -1; }
+        int peek() { return _pos < _size ? _data[_pos] : -1; }
+        size_t write(uint8_t) { return 1; }
+
+protected:
+        const uint8_t *_data;
+        size_t _size;
+        size_t _pos;
+};
+
+class ParserProbe : public TinySIM800
+{
+public:
+        ParserProbe(Stream &port) : TinySIM800(port) {}
+
+        using TinySIM800::readline;
+        using TinySIM800::readRaw;
+        using TinySIM800::parseReply;
+        using TinySIM800::parseReplyQuoted;
+};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  if (size == 0)
+    return 0;
+
+  uint8_t target = data[0];
+  FuzzStream stream(data + 1, size - 1);
+  ParserProbe modem(stream);
+
+  switch (target % 7)
+  {
+  case 0:
+    while (stream.available())
+      modem.readline(100);
+    break;
+  case 1:
+    while (stream.available())
+      modem.readline(100, true);
+    break;
+  case 2:
+    while (stream.available())
+      modem.readRaw(target, 10);
+    break;
+  case 3:
+  {
+    uint16_t v;
+    char s[256]; // a field can be as long as the replybuffer
+    while (stream.available())
+    {
+      modem.readline(100);
+      modem.parseReply(F("+CSQ: "), &v, ',', target / 7 % 4);
+      modem.parseReply(F("+CSQ: "), s, ',', target / 7 % 4);
+    }
+    break;
+  }
+  case 4:
+  {
+    char s[16];
+    while (stream.available())
+    {
+      modem.readline(100);
+      modem.parseReplyQuoted(F("+CDNSGIP: "), s, sizeof(s), ',', target / 7 % 4);
+    }
+    break;
+  }
+  case 5:
+    while (stream.available())
+      modem.getTime();
+    break;
+  case 6:
+  {
+    char s[20];
+    uint16_t len;
+    while (stream.available())
+      modem.sendUSSD((char *)"*101#", s, target / 7 % sizeof(s), &len);
+    break;
+  }
+  }
+
+  return 0;
+}
+
+#ifndef LIBFUZZER
+
+static const char *fragments[] = {
+    "\r\n", "\r", "\n", "OK", "ERROR", ",", "\"", ":", " ", "-", "+", "0", "1", "99", "65535", "4294967296",
+    "+CSQ: ", "+CCLK: \"", "21/03/14,12:30:05+04\"", "+CUSD: ", "0,\"", "+CDNSGIP: ", "1,\"host\",\"1.2.3.4\"",
+    "+CREG: ", "+CGREG: ", "2,1,\"1A2B\",\"00FF\"", "*PSUTTZ: ", "2021,3,14,12,30,5,\"+4\",0", "+CTZV: ",
+    "+UGNSINF: ", "1,1,20210314123005.000,52.5,13.4,34.5,0.28,0.0,1,,0.9,1.2,0.8,,12,9,,,38,,",
+    "+HTTPACTION: ", "+HTTPREAD: ", "CLOSED", "+PDP: DEACT", "DST: 1"};
+
+int main(int argc, char **argv)
+{
+  long iterations = argc > 1 ? atol(argv[1]) : 100000;
+  srand(argc > 2 ? atoi(argv[2]) : 1);
+
+  std::string input;
+  for (long i = 0; i < iterations; i++)
+  {
+    input.assign(1, (char)rand());
+
+    int n = rand() % 48;
+    for (int j = 0; j < n; j++)
+    {
+      if (rand() % 8 == 0)
+        input += (char)rand(); // noise
+      else
+        input += fragments[rand() % (sizeof(fragments) / sizeof(fragments[0]))];
+    }
+    if (rand() % 4 == 0)
+      input += std::string(rand() % 600, 'A'); // longer than replybuffer
+
+    LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+  }
+
+  printf("fuzz_parsers: %ld inputs\n", iterations);
+  return 0;
+}
+
+#endif
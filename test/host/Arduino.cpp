@@ -0,0 +1,69 @@
+#include "Arduino.h"
+
+static unsigned long clockMs = 0;
+
+unsigned long millis()
+{
+  static unsigned calls = 0;
+  if (++calls % 16 == 0)
+    clockMs++;
+  return clockMs;
+}
+
+unsigned long micros()
+{
+  return clockMs * 1000;
+}
+
+void delay(unsigned long ms)
+{
+  clockMs += ms;
+}
+
+void advanceClock(unsigned long ms)
+{
+  clockMs += ms;
+}
+
+long random(long max)
+{
+  return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max)
+{
+  return max > min ? min + rand() % (max - min) : min;
+}
+
+void yield()
+{
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+    n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(long v, int base)
+{
+  if (v < 0 && base == DEC)
+    return print('-') + print((unsigned long)-v, base);
+  return print((unsigned long)v, base);
+}
+
+size_t Print::print(unsigned long v, int base)
+{
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%lu", v);
+  return write(buffer);
+}
+
+size_t Print::print(double v, int digits)
+{
+  char buffer[48];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, v);
+  return write(buffer);
+}
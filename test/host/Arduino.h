@@ -0,0 +1,86 @@
+#pragma once
+
+// Just enough of the Arduino core to build the library on a Linux host, for
+// the tests, fuzzers and benchmarks in this directory. millis() runs on a
+// virtual clock: delay() advances it, and so does every 16th call to
+// millis(), so busy-wait loops terminate without real waiting.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define PGM_P const char *
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strncasecmp_P strncasecmp
+#define strstr_P strstr
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+
+#define DEC 10
+#define HEX 16
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+long random(long max);
+long random(long min, long max);
+void yield();
+
+// virtual clock control for tests
+void advanceClock(unsigned long ms);
+
+class Print
+{
+public:
+        virtual ~Print() {}
+
+        virtual size_t write(uint8_t) = 0;
+        virtual size_t write(const uint8_t *buffer, size_t size);
+        size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+        size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+        virtual void flush() {}
+
+        size_t print(const __FlashStringHelper *s) { return write((const char *)s); }
+        size_t print(const char *s) { return write(s); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(int v, int base = DEC) { return print((long)v, base); }
+        size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+        size_t print(long v, int base = DEC);
+        size_t print(unsigned long v, int base = DEC);
+        size_t print(double v, int digits = 2);
+
+        size_t println() { return write("\r\n"); }
+        template <typename T>
+        size_t println(T v) { return print(v) + println(); }
+        template <typename T>
+        size_t println(T v, int base) { return print(v, base) + println(); }
+};
+
+class Stream : public Print
+{
+public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+};
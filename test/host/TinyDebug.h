@@ -0,0 +1,4 @@
+#pragma once
+
+#define DEBUG_PRINT(...)
+#define DEBUG_PRINTLN(...)
@@ -0,0 +1,75 @@
+// AdaptiveTimeout's table, the long waits the driver learns, and deadlines
+// on the clock.
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+
+class Probe : public TinySIM800
+{
+public:
+        Probe(Stream &port) : TinySIM800(port) {}
+
+        using TinySIM800::TCPstart;
+};
+
+static void testBusyCommandKeepsItsEntry()
+{
+  AdaptiveTimeout adaptive;
+  static const char commands[ADAPTIVE_TIMEOUT_COMMANDS * 2] = {0};
+  const void *busy = &commands[0];
+
+  // the busy command in between many others that are sent once in a while
+  for (int i = 0; i < 4 * ADAPTIVE_TIMEOUT_MIN_SAMPLES; i++)
+  {
+    adaptive.record(busy, 20);
+    adaptive.record(&commands[1 + i % (sizeof(commands) - 1)], 500);
+  }
+
+  CHECK(adaptive.latency(busy, 95) == 31);
+  CHECK(adaptive.timeout(busy, 1000) == 100); // the floor
+}
+
+static void testConnectWaitLearned()
+{
+  SimModem sim;
+  Probe modem(sim);
+  AdaptiveTimeout adaptive;
+  adaptive.configure(100, 30000);
+  modem.setAdaptiveTimeout(&adaptive);
+
+  for (int i = 0; i < ADAPTIVE_TIMEOUT_MIN_SAMPLES; i++)
+    CHECK(modem.TCPstart((char *)"10.0.0.1", 80));
+
+  // no CONNECT OK this time: the wait ends on the learned timeout, not
+  // on the nominal 10 s
+  sim.reply("AT+CIPSTART=", "\r\nOK\r\n");
+  uint32_t start = millis();
+  CHECK(!modem.TCPstart((char *)"10.0.0.1", 80));
+  CHECK(millis() - start < 1000);
+}
+
+// init gives a silent modem 7 s in all, the time spent waiting for the
+// replies included
+static void testInitGivesUp()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  sim.reply("AT", "");
+
+  uint32_t start = millis();
+  CHECK(!modem.reset());
+  uint32_t elapsed = millis() - start;
+
+  // plus the attempt under way at the deadline, the last ditch ATs and ATE0
+  CHECK(elapsed >= 7000);
+  CHECK(elapsed < 7000 + 1500 + 3 * 600 + 1100 + 500);
+}
+
+int main()
+{
+  testBusyCommandKeepsItsEntry();
+  testConnectWaitLearned();
+  testInitGivesUp();
+
+  return checkResult("test_adaptive_timeout");
+}
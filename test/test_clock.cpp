@@ -0,0 +1,37 @@
+// The network clock behind now().
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+
+static void testSyncRateLimited()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+
+  // never heard from the network: counts from 2004
+  sim.reply("AT+CCLK?", "\r\n+CCLK: \"04/01/01,00:00:10+00\"\r\n\r\nOK\r\n");
+  for (int i = 0; i < 20; i++)
+  {
+    CHECK(modem.now() == 0);
+    delay(100);
+  }
+  CHECK(sim.count("AT+CCLK?") == 1);
+
+  advanceClock(FONA_TIME_SYNC_RETRY_MS);
+  sim.reply("AT+CCLK?", "\r\n+CCLK: \"21/03/14,12:30:05+04\"\r\n\r\nOK\r\n");
+  CHECK(modem.now() == 1615721405UL); // 11:30:05 UTC
+  CHECK(modem.getTimeZone() == 4);
+  CHECK(sim.count("AT+CCLK?") == 2);
+
+  // known from now on
+  advanceClock(2000);
+  CHECK(modem.now() == 1615721407UL);
+  CHECK(sim.count("AT+CCLK?") == 2);
+}
+
+int main()
+{
+  testSyncRateLimited();
+
+  return checkResult("test_clock");
+}
@@ -0,0 +1,125 @@
+// CommandQueue with several producer threads and one owner thread running
+// process(). Also built with ThreadSanitizer (make tsan).
+
+#include <atomic>
+#include <thread>
+
+#include "SimModem.h"
+#include "CommandQueue.h"
+
+static const int producers = 4;
+static const int perProducer = 1000;
+
+struct Job
+{
+  std::atomic<int> runs;
+  std::atomic<int> done;
+  bool accepted; // written by its producer only, read after join
+};
+
+static Job jobs[producers * perProducer];
+
+static bool runJob(TinySIM800 &modem, void *context)
+{
+  ((Job *)context)->runs.fetch_add(1);
+  return true;
+}
+
+static void jobDone(bool ok, void *context)
+{
+  if (ok)
+    ((Job *)context)->done.fetch_add(1);
+}
+
+static void testProducersAgainstProcess()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  static CommandQueue<8> queue;
+
+  for (int i = 0; i < producers * perProducer; i++)
+  {
+    jobs[i].runs.store(0);
+    jobs[i].done.store(0);
+    jobs[i].accepted = false;
+  }
+
+  std::atomic<int> finished(0);
+  std::thread owner([&]() {
+    for (;;)
+    {
+      // read the flag first: a producer's submits all happen before it
+      // counts itself finished
+      bool last = finished.load() == producers;
+      queue.process(modem);
+      if (last)
+        break;
+      std::this_thread::yield();
+    }
+  });
+
+  std::thread threads[producers];
+  for (int t = 0; t < producers; t++)
+    threads[t] = std::thread([t, &finished]() {
+      for (int i = 0; i < perProducer; i++)
+      {
+        Job &job = jobs[t * perProducer + i];
+        ModemCommand command = {runJob, jobDone, &job, NULL};
+        job.accepted = queue.submit(command);
+        if (i % 64 == 0)
+          std::this_thread::yield();
+      }
+      finished.fetch_add(1);
+    });
+
+  for (int t = 0; t < producers; t++)
+    threads[t].join();
+  owner.join();
+
+  int accepted = 0;
+  for (int i = 0; i < producers * perProducer; i++)
+  {
+    int expected = jobs[i].accepted ? 1 : 0;
+    CHECK(jobs[i].runs.load() == expected);
+    CHECK(jobs[i].done.load() == expected);
+    accepted += expected;
+  }
+
+  CHECK(accepted > 0);
+  CHECK(queue.rejected() == producers * perProducer - accepted);
+}
+
+// a completion is signalled on the owner thread and seen by the submitter
+static void testCompletion()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  static CommandQueue<2> queue;
+  static Job job;
+  job.runs.store(0);
+
+  CommandCompletion completion;
+  ModemCommand command = {runJob, NULL, &job, &completion};
+  CHECK(queue.submit(command));
+  CHECK(!completion.ready());
+
+  std::thread owner([&]() {
+    while (!queue.process(modem))
+      std::this_thread::yield();
+  });
+
+  while (!completion.ready())
+    std::this_thread::yield();
+  owner.join();
+
+  CHECK(completion.ok());
+  CHECK(job.runs.load() == 1);
+}
+
+int main()
+{
+  testProducersAgainstProcess();
+  testCompletion();
+
+  return checkResult("test_command_queue");
+}
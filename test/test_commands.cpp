@@ -0,0 +1,237 @@
+// The command and reply table (Commands.h) against the strings the modem
+// actually sends and expects, written out here independently of it.
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+
+class Probe : public TinySIM800
+{
+public:
+        Probe(Stream &port) : TinySIM800(port) {}
+
+        using TinySIM800::sendCommand;
+        using TinySIM800::readline;
+        using TinySIM800::isReply;
+        using TinySIM800::isReplyPrefix;
+        using TinySIM800::initiateHTTP;
+};
+
+struct Command
+{
+  ATCommand id;
+  const char *line;
+};
+
+static const Command commands[] = {
+    {CMD_AT, "AT"},
+    {CMD_ATE0, "ATE0"},
+    {CMD_ATI, "ATI"},
+    {CMD_AT_W, "AT&W"},
+    {CMD_CVHU, "AT+CVHU="},
+    {CMD_CREG, "AT+CREG="},
+    {CMD_CREG_READ, "AT+CREG?"},
+    {CMD_CGREG, "AT+CGREG="},
+    {CMD_CGREG_READ, "AT+CGREG?"},
+    {CMD_IPREX, "AT+IPREX="},
+    {CMD_IFC, "AT+IFC="},
+    {CMD_CBC, "AT+CBC"},
+    {CMD_GSN, "AT+GSN"},
+    {CMD_GMR, "AT+GMR"},
+    {CMD_CSCLK, "AT+CSCLK="},
+    {CMD_CSQ, "AT+CSQ"},
+    {CMD_CENG, "AT+CENG="},
+    {CMD_CENG_READ, "AT+CENG?"},
+    {CMD_CUSD, "AT+CUSD="},
+    {CMD_CLTS, "AT+CLTS="},
+    {CMD_CCLK_READ, "AT+CCLK?"},
+    {CMD_CGNSPWR, "AT+CGNSPWR="},
+    {CMD_CGNSINF, "AT+CGNSINF"},
+    {CMD_CGNSURC, "AT+CGNSURC="},
+    {CMD_SAPBR_OPEN, "AT+SAPBR=1,1"},
+    {CMD_SAPBR_CLOSE, "AT+SAPBR=0,1"},
+    {CMD_SAPBR_CONTYPE, "AT+SAPBR=3,1,\"CONTYPE\",\"GPRS\""},
+    {CMD_SAPBR_APN, "AT+SAPBR=3,1,\"APN\","},
+    {CMD_SAPBR_USER, "AT+SAPBR=3,1,\"USER\","},
+    {CMD_SAPBR_PWD, "AT+SAPBR=3,1,\"PWD\","},
+    {CMD_CSTT, "AT+CSTT=\""},
+    {CMD_CIICR, "AT+CIICR"},
+    {CMD_CGATT, "AT+CGATT="},
+    {CMD_CGATT_READ, "AT+CGATT?"},
+    {CMD_CIPSHUT, "AT+CIPSHUT"},
+    {CMD_CIPMUX, "AT+CIPMUX="},
+    {CMD_CIPRXGET, "AT+CIPRXGET="},
+    {CMD_CIPRXGET_AVAILABLE, "AT+CIPRXGET=4"},
+    {CMD_CDNSGIP, "AT+CDNSGIP=\""},
+    {CMD_CIPSTART, "AT+CIPSTART=\"TCP\",\""},
+    {CMD_CIPCLOSE, "AT+CIPCLOSE"},
+    {CMD_CIPSTATUS, "AT+CIPSTATUS"},
+    {CMD_CIPSEND, "AT+CIPSEND="},
+    {CMD_HTTPINIT, "AT+HTTPINIT"},
+    {CMD_HTTPTERM, "AT+HTTPTERM"},
+    {CMD_HTTPPARA_CID, "AT+HTTPPARA=\"CID\",1"},
+    {CMD_HTTPPARA_URL, "AT+HTTPPARA=\"URL\",\""},
+    {CMD_HTTPPARA_CONTENT, "AT+HTTPPARA=\"CONTENT\",\"application/json\""},
+    {CMD_HTTPPARA_USERDATA, "AT+HTTPPARA=\"USERDATA\",\""},
+    {CMD_HTTPPARA_BREAK, "AT+HTTPPARA=\"BREAK\","},
+    {CMD_HTTPPARA_BREAKEND, "AT+HTTPPARA=\"BREAKEND\","},
+    {CMD_HTTPDATA, "AT+HTTPDATA="},
+    {CMD_HTTPACTION_GET, "AT+HTTPACTION=0"},
+    {CMD_HTTPACTION_POST, "AT+HTTPACTION=1"},
+    {CMD_HTTPREAD, "AT+HTTPREAD="},
+};
+
+// Replies a command waits for.
+struct Reply
+{
+  ATReply id;
+  const char *text;
+};
+
+static const Reply replies[] = {
+    {REPLY_OK, "OK"},
+    {REPLY_AT, "AT"},
+    {REPLY_SHUT_OK, "SHUT OK"},
+    {REPLY_CONNECT_OK, "CONNECT OK"},
+    {REPLY_CLOSE_OK, "CLOSE OK"},
+    {REPLY_SEND_OK, "SEND OK"},
+    {REPLY_DOWNLOAD, "DOWNLOAD"},
+    {REPLY_STATE_CONNECT_OK, "STATE: CONNECT OK"},
+    {REPLY_STATE_PDP_DEACT, "STATE: PDP DEACT"},
+    {REPLY_CBC, "+CBC: "},
+    {REPLY_CSQ, "+CSQ: "},
+    {REPLY_CGATT, "+CGATT: "},
+    {REPLY_CCLK, "+CCLK: "},
+    {REPLY_CENG, "+CENG: "},
+    {REPLY_CENG_SERVING, "+CENG: 0,\""},
+    {REPLY_CGNSINF, "+CGNSINF: "},
+    {REPLY_CUSD, "+CUSD: "},
+    {REPLY_CDNSGIP, "+CDNSGIP: "},
+    {REPLY_CIPRXGET_2, "+CIPRXGET: 2,"},
+    {REPLY_CIPRXGET_4, "+CIPRXGET: 4,"},
+    {REPLY_HTTPACTION, "+HTTPACTION:"},
+    {REPLY_HTTPACTION_0, "+HTTPACTION: 0,"},
+    {REPLY_HTTPACTION_1, "+HTTPACTION: 1,"},
+    {REPLY_HTTPREAD, "+HTTPREAD: "},
+};
+
+// URCs, as the modem sends them; readline handles them and goes on reading.
+static const char *const urcs[] = {
+    "+CREG: 1,\"1A2B\",\"00FF\"",
+    "+CGREG: 5",
+    "+UGNSINF: 1,1,20161021091812.000,31.221783,121.354528,114.600,0.28,0.0,1,,1.9,2.1,0.9,,10,6,,,42,,",
+    "CLOSED",
+    "+PDP: DEACT",
+    "*PSNWID: \"262\",\"01\",\"Telekom.de\",0,\"Telekom.de\",0",
+    "*PSUTTZ: 2021,3,14,12,30,5,\"+4\",0",
+    "DST: 0",
+    "+CTZV: +4,0",
+};
+
+static void testCommands()
+{
+  SimModem sim;
+  Probe modem(sim);
+
+  CHECK(sizeof(commands) / sizeof(commands[0]) == CMD_COUNT);
+
+  for (uint8_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+  {
+    modem.sendCommand(commands[i].id);
+    sim.println();
+    CHECK(!sim.commands.empty() && sim.commands.back() == commands[i].line);
+    if (sim.commands.empty() || sim.commands.back() != commands[i].line)
+      printf("  command %u sent as \"%s\"\n", i, sim.commands.empty() ? "" : sim.commands.back().c_str());
+  }
+}
+
+static void readReply(SimModem &sim, Probe &modem, const std::string &line)
+{
+  sim.toDriver.clear();
+  sim.feed("\r\n" + line + "\r\n");
+  modem.readline(100);
+}
+
+static void testReplies()
+{
+  SimModem sim;
+  Probe modem(sim);
+
+  // and the URCs, checked below
+  CHECK(sizeof(replies) / sizeof(replies[0]) + sizeof(urcs) / sizeof(urcs[0]) == REPLY_COUNT);
+
+  for (uint8_t i = 0; i < sizeof(replies) / sizeof(replies[0]); i++)
+  {
+    const Reply &r = replies[i];
+    std::string text = r.text;
+
+    readReply(sim, modem, text);
+    CHECK(modem.isReplyPrefix(r.id));
+    CHECK(modem.isReply(r.id));
+
+    // longer: still the prefix, no longer the reply
+    readReply(sim, modem, text + "1");
+    CHECK(modem.isReplyPrefix(r.id));
+    CHECK(!modem.isReply(r.id));
+
+    // one character short, or one different
+    readReply(sim, modem, text.substr(0, text.size() - 1));
+    CHECK(!modem.isReplyPrefix(r.id));
+    CHECK(!modem.isReply(r.id));
+
+    std::string changed = text;
+    changed[changed.size() - 1] ^= 0x20;
+    readReply(sim, modem, changed + "1");
+    CHECK(!modem.isReplyPrefix(r.id));
+  }
+
+  // an empty line matches nothing
+  sim.toDriver.clear();
+  modem.readline(100);
+  CHECK(!modem.isReplyPrefix(REPLY_OK));
+}
+
+static void testUrcs()
+{
+  SimModem sim;
+  Probe modem(sim);
+
+  for (uint8_t i = 0; i < sizeof(urcs) / sizeof(urcs[0]); i++)
+  {
+    // taken out of the way of the reply that follows it
+    sim.toDriver.clear();
+    sim.urc(urcs[i]);
+    sim.urc("OK");
+    modem.readline(100);
+    CHECK(modem.isReply(REPLY_OK));
+    if (!modem.isReply(REPLY_OK))
+      printf("  URC \"%s\" not recognised\n", urcs[i]);
+  }
+
+  // what they did
+  CHECK(modem.getLAC() == 0x1A2B);
+  CHECK(modem.lastGNSSFix().lat == 31221783);
+  CHECK(modem.getTimeZone() == 4);
+}
+
+// the USERDATA header value goes out quoted, after the key
+static void testHeaders()
+{
+  SimModem sim;
+  Probe modem(sim);
+
+  CHECK(modem.initiateHTTP("http://example.com/t", "Authorization: Bearer abc"));
+  CHECK(sim.count("AT+HTTPPARA=\"USERDATA\",\"Authorization: Bearer abc\"") == 1);
+
+  CHECK(modem.initiateHTTP("http://example.com/t"));
+  CHECK(sim.count("AT+HTTPPARA=\"USERDATA\"") == 1);
+}
+
+int main()
+{
+  testCommands();
+  testReplies();
+  testUrcs();
+  testHeaders();
+
+  return checkResult("test_commands");
+}
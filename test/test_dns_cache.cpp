@@ -0,0 +1,107 @@
+// DNSCache on its own, and TCPconnect resolving through it.
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+
+static void testExpiry()
+{
+  DNSCache dns(60000);
+  dns.store("example.com", "93.184.216.34");
+
+  CHECK(dns.lookup("example.com") != NULL && strcmp(dns.lookup("example.com"), "93.184.216.34") == 0);
+  CHECK(dns.lookup("example.org") == NULL);
+
+  advanceClock(59000);
+  CHECK(dns.lookup("example.com") != NULL);
+  advanceClock(2000);
+  CHECK(dns.lookup("example.com") == NULL);
+
+  // storing again starts a new period
+  dns.store("example.com", "93.184.216.35");
+  advanceClock(30000);
+  CHECK(dns.lookup("example.com") != NULL && strcmp(dns.lookup("example.com"), "93.184.216.35") == 0);
+
+  dns.invalidate("example.com");
+  CHECK(dns.lookup("example.com") == NULL);
+}
+
+static void testEviction()
+{
+  DNSCache dns(600000);
+
+  dns.store("a.example", "10.0.0.1");
+  advanceClock(1000);
+  dns.store("b.example", "10.0.0.2");
+  advanceClock(1000);
+
+  // a host already there keeps its slot
+  dns.store("b.example", "10.0.0.3");
+  CHECK(dns.lookup("a.example") != NULL);
+
+  // full: the entry resolved longest ago goes
+  advanceClock(1000);
+  dns.store("c.example", "10.0.0.4");
+  CHECK(dns.lookup("a.example") == NULL);
+  CHECK(dns.lookup("b.example") != NULL && strcmp(dns.lookup("b.example"), "10.0.0.3") == 0);
+  CHECK(dns.lookup("c.example") != NULL);
+
+  // too long to keep: ignored, nothing evicted
+  dns.store("a-very-long-host-name.example.com", "10.0.0.5");
+  CHECK(dns.lookup("a-very-long-host-name.example.com") == NULL);
+  CHECK(dns.lookup("b.example") != NULL && dns.lookup("c.example") != NULL);
+}
+
+static void testConnectResolvesOnce()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  DNSCache dns(60000);
+  modem.setDNSCache(&dns);
+  sim.reply("AT+CDNSGIP=", "\r\nOK\r\n\r\n+CDNSGIP: 1,\"example.com\",\"93.184.216.34\"\r\n");
+
+  CHECK(modem.TCPconnect((char *)"example.com", 80));
+  CHECK(sim.count("AT+CDNSGIP=\"example.com\"") == 1);
+  CHECK(sim.count("AT+CIPSTART=\"TCP\",\"93.184.216.34\",\"80\"") == 1);
+
+  CHECK(modem.TCPconnect((char *)"example.com", 80));
+  CHECK(sim.count("AT+CDNSGIP=") == 1);
+  CHECK(sim.count("AT+CIPSTART=\"TCP\",\"93.184.216.34\",\"80\"") == 2);
+
+  // addresses are not looked up
+  CHECK(modem.TCPconnect((char *)"10.0.0.1", 80));
+  CHECK(sim.count("AT+CDNSGIP=") == 1);
+
+  // expired: resolved again
+  advanceClock(61000);
+  CHECK(modem.TCPconnect((char *)"example.com", 80));
+  CHECK(sim.count("AT+CDNSGIP=") == 2);
+}
+
+// when the modem can't resolve the name, it is left to AT+CIPSTART
+static void testFallbackWhenLookupFails()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  DNSCache dns;
+  modem.setDNSCache(&dns);
+
+  sim.reply("AT+CDNSGIP=", "\r\nOK\r\n\r\n+CDNSGIP: 0,8\r\n");
+  CHECK(modem.TCPconnect((char *)"example.com", 80));
+  CHECK(sim.count("AT+CIPSTART=\"TCP\",\"example.com\",\"80\"") == 1);
+  CHECK(dns.lookup("example.com") == NULL);
+
+  sim.reply("AT+CDNSGIP=", "\r\nERROR\r\n");
+  CHECK(modem.TCPconnect((char *)"example.com", 80));
+  CHECK(sim.count("AT+CIPSTART=\"TCP\",\"example.com\",\"80\"") == 2);
+  CHECK(dns.lookup("example.com") == NULL);
+}
+
+int main()
+{
+  testExpiry();
+  testEviction();
+  testConnectResolvesOnce();
+  testFallbackWhenLookupFails();
+
+  return checkResult("test_dns_cache");
+}
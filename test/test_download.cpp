@@ -0,0 +1,114 @@
+// downloadHTTP in ranges against the simulated modem's HTTP GET, with the
+// link dropping partway and the download resumed from its state.
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+
+// the file, and its digests as computed by zlib.crc32 and hashlib.sha256
+static std::string payload(size_t n)
+{
+  std::string s;
+  for (size_t i = 0; i < n; i++)
+    s += (char)((i * 7 + i / 256) & 0xFF);
+  return s;
+}
+
+static const uint32_t crc3000 = 0x225c866f;
+static const char *sha3000 = "f49a000aeb937be459f9cf5769cfade4e352b54f4890d7d7b7cd12e348df68cf";
+static const uint32_t crc2048 = 0x3870b657;
+static const char *sha2048 = "76de9e1233c1e351dd6ea927f0ae21ec2eea81065e40143b4303a2f44019f6da";
+
+class StringSink : public DownloadSink
+{
+public:
+        StringSink() : largest(0) {}
+
+        std::string data;
+        uint16_t largest;
+
+        bool write(uint32_t offset, const uint8_t *p, uint16_t len)
+        {
+          CHECK(offset == data.size());
+          data.append((const char *)p, len);
+          if (len > largest)
+            largest = len;
+          return true;
+        }
+};
+
+static std::string hex(Sha256 &sha)
+{
+  uint8_t hash[32];
+  sha.finish(hash);
+
+  char s[65];
+  for (int i = 0; i < 32; i++)
+    snprintf(s + 2 * i, 3, "%02x", hash[i]);
+  return s;
+}
+
+static void testResumeAfterLinkDrop()
+{
+  SimModem sim;
+  sim.httpFile = payload(3000);
+  sim.httpDropAfter = 1700; // in the second segment, inside a chunk
+  TinySIM800 modem(sim);
+  RetryPolicy policy = {2, 100, 1000, 0, 0};
+  modem.setRetryPolicy(policy);
+
+  Sha256 sha;
+  DownloadState state(&sha);
+  StringSink sink;
+
+  CHECK(!modem.downloadHTTP("http://example.com/fw.bin", sink, state, 1024, 300));
+  CHECK(!state.complete);
+  CHECK(state.offset == 1700);
+  CHECK(sink.data == sim.httpFile.substr(0, 1700));
+  CHECK(sim.count("AT+HTTPPARA=\"BREAK\",1024") == 1);
+
+  sim.httpLinkUp = true;
+  CHECK(modem.downloadHTTP("http://example.com/fw.bin", sink, state, 1024, 300));
+  CHECK(state.complete);
+  CHECK(state.offset == 3000);
+  CHECK(sink.data == sim.httpFile);
+
+  // went on from where it stopped, not from the start of the segment (the
+  // retry while the link was down, then the resumed download)
+  CHECK(sim.count("AT+HTTPPARA=\"BREAK\",1700") == 2);
+  CHECK(sim.count("AT+HTTPPARA=\"BREAK\",2724") == 1);
+
+  // the checksums carried on over both attempts
+  CHECK(state.crc.value() == crc3000);
+  CHECK(hex(sha) == sha3000);
+
+  // pieces no larger than replybuffer
+  CHECK(sink.largest == 254);
+}
+
+// a file that ends on a segment boundary, the last range asked for is
+// past the end
+static void testLastSegmentFull()
+{
+  SimModem sim;
+  sim.httpFile = payload(2048);
+  TinySIM800 modem(sim);
+
+  Sha256 sha;
+  DownloadState state(&sha);
+  StringSink sink;
+
+  CHECK(modem.downloadHTTP("http://example.com/fw.bin", sink, state, 1024, 1024));
+  CHECK(state.complete);
+  CHECK(sink.data == sim.httpFile);
+  CHECK(sim.count("AT+HTTPACTION=0") == 3);
+  CHECK(state.crc.value() == crc2048);
+  CHECK(hex(sha) == sha2048);
+}
+
+int main()
+{
+  testResumeAfterLinkDrop();
+  testLastSegmentFull();
+
+  return checkResult("test_download");
+}
@@ -0,0 +1,82 @@
+// RTS/CTS flow control: URCs held back by the modem, and bodies cut off by
+// CTS.
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+
+static SimModem *sim;
+static int ctsLeft; // CTS looks asserted this many more times
+
+static void rts(bool on) { sim->rtsAsserted = on; }
+static bool cts() { return ctsLeft-- > 0; }
+
+static uint16_t measureBody() { return 100; }
+static void streamBody(Stream &s)
+{
+  for (int i = 0; i < 100; i++)
+    s.write('x');
+}
+
+static void testPollAssertsRts()
+{
+  SimModem modem;
+  sim = &modem;
+  modem.holdOnRts = true;
+  TinySIM800 driver(modem);
+  driver.setFlowControlPins(cts, rts);
+
+  // held by the modem until RTS goes up
+  modem.urc("+CTZV: +8");
+  driver.poll();
+  CHECK(driver.getTimeZone() == 8);
+  CHECK(!modem.rtsAsserted);
+}
+
+static void testPostAbandonedOnCtsTimeout()
+{
+  SimModem modem;
+  sim = &modem;
+  TinySIM800 driver(modem);
+  driver.setFlowControlPins(cts, rts);
+  ctsLeft = 30;
+
+  CHECK(!driver.postHTTP("example.com/v1", NULL, measureBody, streamBody, NULL));
+
+  // the rest of the body was padded, and nothing was sent again
+  CHECK(!modem.inDataMode());
+  CHECK(modem.httpBody.size() == 100);
+  CHECK(modem.count("AT+HTTPDATA=") == 1);
+  CHECK(modem.count("AT+HTTPACTION=") == 0);
+  CHECK(modem.count("AT+HTTPTERM") == 1);
+}
+
+static void testSendCancelledOnCtsTimeout()
+{
+  SimModem modem;
+  sim = &modem;
+  TinySIM800 driver(modem);
+  driver.setFlowControlPins(cts, rts);
+
+  ctsLeft = 1000;
+  CHECK(driver.TCPconnect((char *)"10.0.0.1", 1883));
+
+  ctsLeft = 3;
+  char packet[] = "0123456789";
+  CHECK(!driver.TCPsend(packet, 10));
+  CHECK(!modem.inDataMode());
+  CHECK(modem.fromClient.empty());
+
+  // and the modem takes commands again
+  ctsLeft = 1000;
+  CHECK(driver.TCPsend(packet, 10));
+  CHECK(modem.fromClient == packet);
+}
+
+int main()
+{
+  testPollAssertsRts();
+  testPostAbandonedOnCtsTimeout();
+  testSendCancelledOnCtsTimeout();
+
+  return checkResult("test_flow_control");
+}
@@ -0,0 +1,125 @@
+// GNSS (SIM808/SIM868): +CGNSINF/+UGNSINF parsing and the gnssFix event.
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+
+class Probe : public TinySIM800
+{
+public:
+        Probe(Stream &port) : TinySIM800(port) {}
+
+        using TinySIM800::parseGNSS;
+};
+
+// the field lists, as after "+CGNSINF: " or "+UGNSINF: "
+static void testParseFix()
+{
+  SimModem sim;
+  Probe modem(sim);
+  GNSSFix fix;
+
+  CHECK(modem.parseGNSS("1,1,20161021091812.000,31.221783,121.354528,114.600,0.28,0.0,1,,1.9,2.1,0.9,,10,6,,,42,,", &fix));
+  CHECK(fix.fixed);
+  CHECK(fix.time == 1477041492);
+  CHECK(fix.lat == 31221783);
+  CHECK(fix.lon == 121354528);
+  CHECK(fix.alt == 1146);
+  CHECK(fix.speed == 28);
+  CHECK(fix.course == 0);
+  CHECK(fix.hdop == 19);
+  CHECK(fix.satsInView == 10);
+  CHECK(fix.satsUsed == 6);
+
+  // southern and western hemisphere
+  CHECK(modem.parseGNSS("1,1,20210314123005.000,-33.868820,-70.653030,520.3,12.50,271.33,1,,0.8,1.2,0.9,,14,9,5,,38,,", &fix));
+  CHECK(fix.time == 1615725005);
+  CHECK(fix.lat == -33868820);
+  CHECK(fix.lon == -70653030);
+  CHECK(fix.alt == 5203);
+  CHECK(fix.speed == 1250);
+  CHECK(fix.course == 27133);
+  CHECK(fix.hdop == 8);
+}
+
+static void testParseNoFix()
+{
+  SimModem sim;
+  Probe modem(sim);
+  GNSSFix fix;
+
+  // searching: time known, position fields empty
+  CHECK(modem.parseGNSS("1,0,20161021091812.000,,,,0.00,0.0,0,,,,,,10,0,,,,,", &fix));
+  CHECK(!fix.fixed);
+  CHECK(fix.time == 1477041492);
+  CHECK(fix.lat == 0 && fix.lon == 0 && fix.alt == 0);
+  CHECK(fix.hdop == 0);
+  CHECK(fix.satsInView == 10);
+  CHECK(fix.satsUsed == 0);
+
+  // cold start, no time yet
+  CHECK(modem.parseGNSS("1,0,19800106000050.000,,,,0.00,0.0,0,,,,,,0,0,,,,,", &fix));
+  CHECK(!fix.fixed);
+  CHECK(fix.lat == 0);
+
+  // GNSS powered off: every field empty
+  CHECK(modem.parseGNSS("0,,,,,,,,,,,,,,,,,,,,", &fix));
+  CHECK(!fix.fixed);
+  CHECK(fix.time == 0);
+
+  // cut short
+  CHECK(!modem.parseGNSS("1,1,20161021091812.000,31.22", &fix));
+  CHECK(!modem.parseGNSS("", &fix));
+}
+
+static TinySIM800 *driver;
+static int fixes;
+static GNSSFix reported;
+static uint8_t rssiInHandler;
+
+static void onFix(void *sender, EventArgs *e)
+{
+  fixes++;
+  reported = *(GNSSFix *)e;
+  // handlers may talk to the modem themselves
+  rssiInHandler = driver->getRSSI();
+}
+
+static void testEventFiredFromPoll()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  driver = &modem;
+  modem.gnssFix += onFix;
+  fixes = 0;
+
+  // a URC in the middle of another command's reply
+  sim.reply("AT+CSQ", "\r\n+UGNSINF: 1,1,20161021091812.000,31.221783,121.354528,114.600,0.28,0.0,1,,1.9,2.1,0.9,,10,6,,,42,,\r\n"
+                      "\r\n+CSQ: 17,0\r\n\r\nOK\r\n");
+  CHECK(modem.getRSSI() == 17);
+  CHECK(fixes == 0);
+
+  sim.reply("AT+CSQ", "\r\n+CSQ: 20,0\r\n\r\nOK\r\n");
+  modem.poll();
+  CHECK(fixes == 1);
+  CHECK(reported.lat == 31221783);
+  CHECK(rssiInHandler == 20);
+
+  // reported once
+  modem.poll();
+  CHECK(fixes == 1);
+
+  // a garbled URC neither fires nor replaces the last fix
+  sim.urc("+UGNSINF: 1,1,2016");
+  modem.poll();
+  CHECK(fixes == 1);
+  CHECK(modem.lastGNSSFix().lat == 31221783);
+}
+
+int main()
+{
+  testParseFix();
+  testParseNoFix();
+  testEventFiredFromPoll();
+
+  return checkResult("test_gnss");
+}
@@ -0,0 +1,85 @@
+// HTTPSession keep-alive against a web server behind the simulated modem.
+
+#include "SimModem.h"
+#include "HTTPSession.h"
+
+static std::string body;
+
+// Answers every request with 200 and the body, keeping the connection.
+static void webServer(SimModem &sim, const std::string &block)
+{
+  char head[96];
+  snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n\r\n", (unsigned)body.size());
+  sim.toClient += head + body;
+}
+
+class StringSink : public DownloadSink
+{
+public:
+        std::string data;
+
+        bool write(uint32_t offset, const uint8_t *p, uint16_t len)
+        {
+          CHECK(offset == data.size());
+          data.append((const char *)p, len);
+          return true;
+        }
+};
+
+static void testTwoRequestsOnOneConnection()
+{
+  SimModem sim;
+  sim.server = webServer;
+  body = "{\"id\":1}";
+  TinySIM800 modem(sim);
+  HTTPSession session(modem);
+
+  CHECK(session.connect((char *)"10.0.0.1"));
+
+  for (int i = 0; i < 2; i++)
+  {
+    CHECK(session.request("GET", "/v1/things"));
+
+    HTTPResponse response;
+    StringSink sink;
+    CHECK(session.response(response, &sink));
+    CHECK(response.status == 200);
+    CHECK(response.keepAlive);
+    CHECK(sink.data == body);
+    CHECK(session.connected());
+  }
+
+  CHECK(sim.count("AT+CIPSTART=") == 1);
+  CHECK(sim.count("AT+CIPSEND=") == 2);
+}
+
+static void testLargeBodyReadInFewCommands()
+{
+  SimModem sim;
+  sim.server = webServer;
+  body = std::string(1000, 'x');
+  TinySIM800 modem(sim);
+  HTTPSession session(modem);
+
+  CHECK(session.connect((char *)"10.0.0.1"));
+  CHECK(session.request("GET", "/firmware.bin"));
+
+  HTTPResponse response;
+  StringSink sink;
+  CHECK(session.response(response, &sink));
+  CHECK(response.received == 1000);
+  CHECK(sink.data == body);
+
+  // the modem said how much it has once, reads are as large as the buffer
+  CHECK(sim.count("AT+CIPRXGET=4") == 1);
+  uint32_t total = 41 + 1000; // headers and body
+  CHECK(sim.count("AT+CIPRXGET=2,") == (total + HTTP_RX_BUFFER_SIZE - 1) / HTTP_RX_BUFFER_SIZE);
+}
+
+int main()
+{
+  testTwoRequestsOnOneConnection();
+  testLargeBodyReadInFewCommands();
+
+  return checkResult("test_http_session");
+}
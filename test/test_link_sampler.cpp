@@ -0,0 +1,54 @@
+// LinkSampler's sampling rate.
+
+#include "SimModem.h"
+#include "LinkSampler.h"
+
+static void testFailedSampleWaitsForInterval()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  LinkSampler sampler(modem, 60000, false);
+
+  sim.reply("AT+CSQ", "\r\nERROR\r\n");
+  for (int i = 0; i < 50; i++)
+  {
+    sampler.loop();
+    delay(100);
+  }
+  CHECK(sim.count("AT+CSQ") == 1);
+  CHECK(sampler.count() == 0);
+
+  advanceClock(60000);
+  sim.reply("AT+CSQ", "\r\n+CSQ: 17,0\r\n\r\nOK\r\n");
+  sampler.loop();
+  sampler.loop();
+  CHECK(sim.count("AT+CSQ") == 2);
+  CHECK(sampler.count() == 1);
+  CHECK(sampler.latest().rssi == 17);
+}
+
+// engineering mode is switched on once, and again after a modem reset
+static void testEngineeringModeAfterReset()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  sim.reply("AT+CENG?", "\r\n+CENG: 1,0\r\n\r\n+CENG: 0,\"0021,35,00,206,01,36,0c51,04,00,2b0c,255\"\r\n\r\nOK\r\n");
+
+  ServingCell cell;
+  CHECK(modem.getServingCell(&cell));
+  CHECK(cell.rxl == 35);
+  CHECK(modem.getServingCell(&cell));
+  CHECK(sim.count("AT+CENG=1,0") == 1);
+
+  CHECK(modem.reset());
+  CHECK(modem.getServingCell(&cell));
+  CHECK(sim.count("AT+CENG=1,0") == 2);
+}
+
+int main()
+{
+  testFailedSampleWaitsForInterval();
+  testEngineeringModeAfterReset();
+
+  return checkResult("test_link_sampler");
+}
@@ -0,0 +1,278 @@
+// MQTTClient against a minimal broker behind the simulated modem.
+
+#include "SimModem.h"
+#include "MQTTClient.h"
+
+static bool acknowledge = true;
+static std::vector<std::string> published; // every PUBLISH the broker got
+
+// CONNACK for CONNECT, PUBACK for QoS 1 PUBLISH (unless acknowledge is
+// off), PINGRESP for PINGREQ.
+static void broker(SimModem &sim, const std::string &block)
+{
+  size_t pos = 0;
+  while (pos + 2 <= block.size())
+  {
+    uint8_t type = block[pos];
+    size_t remaining = (uint8_t)block[pos + 1]; // short packets only
+    size_t body = pos + 2;
+
+    if ((type & 0xF0) == 0x10)
+      sim.toClient += std::string("\x20\x02\x00\x00", 4);
+    else if ((type & 0xF0) == 0x30)
+    {
+      published.push_back(block.substr(pos, 2 + remaining));
+      size_t topicLen = ((uint8_t)block[body] << 8) | (uint8_t)block[body + 1];
+      if ((type & 0x06) == 0x02 && acknowledge)
+        sim.toClient += std::string("\x40\x02", 2) + block.substr(body + 2 + topicLen, 2);
+    }
+    else if (type == 0xC0)
+      sim.toClient += std::string("\xD0\x00", 2);
+
+    pos = body + remaining;
+  }
+}
+
+static void testPublishAfterConnect()
+{
+  SimModem sim;
+  sim.server = broker;
+  TinySIM800 modem(sim);
+  MQTTClient mqtt(modem);
+
+  CHECK(mqtt.connect((char *)"10.0.0.1", 1883, "tracker"));
+  CHECK(mqtt.connected());
+
+  // the CONNACK was read with AT+CIPRXGET=2, its OK must not confuse the
+  // next AT+CIPSEND
+  CHECK(mqtt.publish("pos", "52.52,13.40", 1));
+  mqtt.loop();
+  CHECK(mqtt.connected());
+
+  // the PUBACK arrives on the next loop
+  mqtt.loop();
+  CHECK(mqtt.connected());
+  CHECK(mqtt.pending() == 0);
+
+  CHECK(mqtt.publish("pos", "52.53,13.41", 1));
+  mqtt.loop();
+  mqtt.loop();
+  CHECK(mqtt.connected());
+  CHECK(mqtt.pending() == 0);
+
+  CHECK(sim.count("AT+CIPSEND=") == 3);
+}
+
+static void testSendDoesNotWaitOutPrompt()
+{
+  SimModem sim;
+  sim.server = broker;
+  TinySIM800 modem(sim);
+  MQTTClient mqtt(modem);
+
+  CHECK(mqtt.connect((char *)"10.0.0.1", 1883, "tracker"));
+
+  // "> " has no line end: the send must go on as soon as it is there
+  // instead of waiting for a readline timeout
+  CHECK(mqtt.publish("pos", "52.52,13.40"));
+  uint32_t start = millis();
+  mqtt.loop();
+  CHECK(millis() - start < 400);
+  CHECK(mqtt.connected());
+}
+
+// a QoS 1 publish without PUBACK goes out again with DUP set, same packet
+// id and payload, until it is acknowledged
+static void testResendWithoutPuback()
+{
+  SimModem sim;
+  sim.server = broker;
+  acknowledge = false;
+  published.clear();
+  TinySIM800 modem(sim);
+  MQTTClient mqtt(modem);
+
+  CHECK(mqtt.connect((char *)"10.0.0.1", 1883, "tracker", NULL, NULL, 30));
+  CHECK(mqtt.publish("pos", "52.52,13.40", 1));
+  mqtt.loop();
+  CHECK(published.size() == 1);
+  CHECK(mqtt.pending() == 1);
+
+  // nothing is resent before the keepalive period is over
+  advanceClock(10000);
+  mqtt.loop();
+  CHECK(published.size() == 1);
+
+  advanceClock(25000);
+  mqtt.loop(); // queues the duplicate
+  mqtt.loop(); // sends it
+  CHECK(mqtt.connected());
+  CHECK(published.size() == 2);
+  CHECK(mqtt.resent() == 1);
+  CHECK(mqtt.pending() == 1);
+
+  std::string dup = published[0];
+  dup[0] |= 0x08;
+  CHECK(published.size() == 2 && published[1] == dup);
+
+  acknowledge = true;
+  advanceClock(31000);
+  mqtt.loop();
+  mqtt.loop();
+  mqtt.loop();
+  CHECK(mqtt.pending() == 0);
+
+  // acknowledged, not sent again
+  size_t sent = published.size();
+  advanceClock(31000);
+  mqtt.loop();
+  mqtt.loop();
+  CHECK(published.size() == sent);
+}
+
+// a failed send keeps the publishes in flight, connect() sends them again
+static void testResendAfterReconnect()
+{
+  SimModem sim;
+  sim.server = broker;
+  acknowledge = true;
+  published.clear();
+  TinySIM800 modem(sim);
+  MQTTClient mqtt(modem);
+
+  CHECK(mqtt.connect((char *)"10.0.0.1", 1883, "tracker"));
+  CHECK(mqtt.publish("pos", "52.52,13.40", 1));
+  CHECK(mqtt.publish("pos", "52.53,13.41", 1));
+
+  sim.reply("AT+CIPSEND=", "\r\nERROR\r\n");
+  mqtt.loop();
+  CHECK(!mqtt.connected());
+  CHECK(mqtt.pending() == 2);
+  CHECK(published.empty());
+
+  sim.clearReply("AT+CIPSEND=");
+  CHECK(mqtt.connect((char *)"10.0.0.1", 1883, "tracker"));
+  CHECK(published.size() == 2);
+  CHECK(published.size() == 2 && ((uint8_t)published[0][0] & 0x08) && ((uint8_t)published[1][0] & 0x08));
+  CHECK(published.size() == 2 && published[0].find("52.52,13.40") != std::string::npos);
+  CHECK(published.size() == 2 && published[1].find("52.53,13.41") != std::string::npos);
+
+  mqtt.loop();
+  mqtt.loop();
+  CHECK(mqtt.pending() == 0);
+}
+
+// publishes are refused while there is no room to keep a copy
+static void testStoreFull()
+{
+  SimModem sim;
+  sim.server = broker;
+  acknowledge = false;
+  TinySIM800 modem(sim);
+  MQTTClient mqtt(modem);
+
+  CHECK(mqtt.connect((char *)"10.0.0.1", 1883, "tracker"));
+
+  char payload[100];
+  memset(payload, 'x', sizeof(payload) - 1);
+  payload[sizeof(payload) - 1] = 0;
+
+  // 2 + 2 + 3 + 2 + 99 = 108 bytes each, two fit into 256
+  CHECK(mqtt.publish("pos", payload, 1));
+  CHECK(mqtt.publish("pos", payload, 1));
+  CHECK(!mqtt.publish("pos", payload, 1));
+  CHECK(mqtt.publish("pos", "small", 0));
+  CHECK(mqtt.pending() == 2);
+
+  acknowledge = true;
+  advanceClock(61000);
+  mqtt.loop();
+  mqtt.loop();
+  mqtt.loop();
+  CHECK(mqtt.pending() == 0);
+  CHECK(mqtt.publish("pos", payload, 1));
+}
+
+static std::vector<std::string> received;
+
+static void onMessage(const char *topic, const uint8_t *payload, uint16_t len)
+{
+  received.push_back(std::string(topic) + "=" + std::string((const char *)payload, len));
+}
+
+// packets larger than the receive buffer are skipped, even past 64 KiB
+static void testSkipHugePacket()
+{
+  SimModem sim;
+  sim.server = broker;
+  TinySIM800 modem(sim);
+  MQTTClient mqtt(modem);
+  mqtt.onMessage(onMessage);
+  received.clear();
+
+  CHECK(mqtt.connect((char *)"10.0.0.1", 1883, "tracker"));
+
+  // PUBLISH with a remaining length of 70000, in pieces the modem can hold
+  sim.toClient += std::string("\x30\xF0\xA2\x04", 4);
+  for (int i = 0; i < 70; i++)
+  {
+    sim.toClient += std::string(1000, 'x');
+    mqtt.loop();
+  }
+  sim.toClient += std::string("\x30\x07\x00\x03" "abc" "hi", 9);
+  mqtt.loop();
+
+  CHECK(mqtt.connected());
+  CHECK(received.size() == 1 && received[0] == "abc=hi");
+}
+
+// a remaining length with a fifth byte closes the connection instead of
+// waiting for a packet end that never comes
+static void testMalformedLength()
+{
+  SimModem sim;
+  sim.server = broker;
+  TinySIM800 modem(sim);
+  MQTTClient mqtt(modem);
+
+  CHECK(mqtt.connect((char *)"10.0.0.1", 1883, "tracker"));
+  sim.toClient += std::string("\x30\xFF\xFF\xFF\xFF\x01", 6);
+  mqtt.loop();
+  CHECK(!mqtt.connected());
+  CHECK(sim.count("AT+CIPCLOSE") == 1);
+}
+
+// PUBLISH and PUBACK too short for their fields are ignored
+static void testShortPackets()
+{
+  SimModem sim;
+  sim.server = broker;
+  TinySIM800 modem(sim);
+  MQTTClient mqtt(modem);
+  mqtt.onMessage(onMessage);
+  received.clear();
+
+  CHECK(mqtt.connect((char *)"10.0.0.1", 1883, "tracker"));
+  sim.toClient += std::string("\x30\x01\x00", 3);
+  sim.toClient += std::string("\x40\x00", 2);
+  sim.toClient += std::string("\x32\x04\x00\x03" "ab", 6); // topic past the end
+  sim.toClient += std::string("\x30\x07\x00\x03" "abc" "hi", 9);
+  mqtt.loop();
+
+  CHECK(mqtt.connected());
+  CHECK(received.size() == 1 && received[0] == "abc=hi");
+}
+
+int main()
+{
+  testPublishAfterConnect();
+  testSendDoesNotWaitOutPrompt();
+  testResendWithoutPuback();
+  testResendAfterReconnect();
+  testStoreFull();
+  testSkipHugePacket();
+  testMalformedLength();
+  testShortPackets();
+
+  return checkResult("test_mqtt");
+}
@@ -0,0 +1,75 @@
+// Registration URCs and the events they lead to.
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+
+static TinySIM800 *driver;
+static int registered;
+static int lost;
+static uint8_t rssiInHandler;
+
+static void onRegistered(void *sender, EventArgs *e)
+{
+  registered++;
+  // handlers may talk to the modem themselves
+  rssiInHandler = driver->getRSSI();
+}
+
+static void onLost(void *sender, EventArgs *e)
+{
+  lost++;
+}
+
+static void testEventsFiredFromPoll()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  driver = &modem;
+  modem.networkRegistered += onRegistered;
+  modem.networkLost += onLost;
+  registered = lost = 0;
+
+  // a URC in the middle of another command's reply
+  sim.reply("AT+CSQ", "\r\n+CREG: 1,\"1A2B\",\"00FF\"\r\n\r\n+CSQ: 17,0\r\n\r\nOK\r\n");
+  CHECK(modem.getRSSI() == 17);
+  CHECK(registered == 0);
+
+  sim.reply("AT+CSQ", "\r\n+CSQ: 20,0\r\n\r\nOK\r\n");
+  modem.poll();
+  CHECK(registered == 1);
+  CHECK(rssiInHandler == 20);
+  CHECK(modem.getLAC() == 0x1A2B);
+
+  // a URC on its own
+  sim.urc("+CREG: 0");
+  CHECK(!modem.isRegistered());
+  CHECK(lost == 1);
+
+  // back and forth between polls: nothing to report
+  sim.urc("+CREG: 1");
+  sim.urc("+CREG: 0");
+  modem.poll();
+  CHECK(registered == 1);
+  CHECK(lost == 1);
+}
+
+static void testSlowUrcReadWhole()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+
+  // longer on the wire than poll's readline timeout
+  sim.msPerByte = 2;
+  sim.urc("+CTZV: +8");
+  modem.poll();
+  CHECK(modem.getTimeZone() == 8);
+  CHECK(sim.toDriver.empty());
+}
+
+int main()
+{
+  testEventsFiredFromPoll();
+  testSlowUrcReadWhole();
+
+  return checkResult("test_registration");
+}
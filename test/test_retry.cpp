@@ -0,0 +1,66 @@
+// What postHTTP retries, and the backoff between attempts.
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+
+static uint16_t measureBody() { return 2; }
+static void streamBody(Stream &s) { s.print("{}"); }
+
+static uint16_t status;
+static void onStatus(const uint16_t code) { status = code; }
+
+static RetryPolicy policy(uint8_t attempts)
+{
+  RetryPolicy p;
+  p.attempts = attempts;
+  p.backoff = 1000;
+  p.maxBackoff = 16000;
+  p.breakerThreshold = 0;
+  p.breakerCooldown = 60000;
+  return p;
+}
+
+static void testPostSentOnce()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  modem.setRetryPolicy(policy(3));
+
+  // accepted, but no +HTTPACTION: the POST may have gone out already
+  CHECK(!modem.postHTTP("example.com/v1", NULL, measureBody, streamBody, onStatus));
+  CHECK(sim.count("AT+HTTPACTION=1") == 1);
+
+  // not accepted: tried again
+  sim.reply("AT+HTTPACTION=1", "\r\nERROR\r\n");
+  CHECK(!modem.postHTTP("example.com/v1", NULL, measureBody, streamBody, onStatus));
+  CHECK(sim.count("AT+HTTPACTION=1") == 1 + 3);
+
+  sim.reply("AT+HTTPACTION=1", "\r\nOK\r\n\r\n+HTTPACTION: 1,201,0\r\n");
+  status = 0;
+  CHECK(modem.postHTTP("example.com/v1", NULL, measureBody, streamBody, onStatus));
+  CHECK(status == 201);
+}
+
+static void testManyAttemptsBackoffCapped()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  modem.setRetryPolicy(policy(40));
+  sim.reply("AT+HTTPINIT", "\r\nERROR\r\n");
+
+  // 39 waits, from the 5th on between maxBackoff / 2 and maxBackoff (and
+  // no shift past 31 bits)
+  uint32_t start = millis();
+  CHECK(!modem.postHTTP("example.com/v1", NULL, measureBody, streamBody, onStatus));
+  CHECK(sim.count("AT+HTTPINIT") == 40);
+  CHECK(millis() - start >= 35 * 8000UL);
+  CHECK(millis() - start < 39 * 17000UL);
+}
+
+int main()
+{
+  testPostSentOnce();
+  testManyAttemptsBackoffCapped();
+
+  return checkResult("test_retry");
+}
@@ -0,0 +1,78 @@
+// TCPconnect sets up the socket once and then only opens connections, until
+// the modem loses that setup.
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+
+static void checkSetups(SimModem &sim, uint32_t n)
+{
+  CHECK(sim.count("AT+CIPSHUT") == n);
+  CHECK(sim.count("AT+CIPMUX=0") == n);
+  CHECK(sim.count("AT+CIPRXGET=1") == n);
+  // the PDP context is connectGPRS' business
+  CHECK(sim.count("AT+CSTT") == 0);
+  CHECK(sim.count("AT+CIICR") == 0);
+}
+
+static void testReconnectSkipsSetup()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+
+  CHECK(modem.TCPconnect((char *)"10.0.0.1", 80));
+  checkSetups(sim, 1);
+  CHECK(sim.count("AT+CIPSTART=") == 1);
+
+  // still open: closed first, nothing else
+  CHECK(modem.TCPconnect((char *)"10.0.0.1", 80));
+  checkSetups(sim, 1);
+  CHECK(sim.count("AT+CIPCLOSE") == 1);
+  CHECK(sim.count("AT+CIPSTART=") == 2);
+
+  // closed by us
+  CHECK(modem.TCPclose());
+  CHECK(sim.count("AT+CIPCLOSE") == 2);
+  CHECK(modem.TCPconnect((char *)"10.0.0.1", 80));
+  checkSetups(sim, 1);
+  CHECK(sim.count("AT+CIPCLOSE") == 2);
+
+  // closed by the server
+  sim.tcpOpen = false;
+  sim.urc("CLOSED");
+  CHECK(modem.TCPconnect((char *)"10.0.0.1", 80));
+  checkSetups(sim, 1);
+  CHECK(sim.count("AT+CIPCLOSE") == 2);
+  CHECK(sim.count("AT+CIPSTART=") == 4);
+}
+
+static void testSetupAgainWhenLost()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+
+  CHECK(modem.TCPconnect((char *)"10.0.0.1", 80));
+  checkSetups(sim, 1);
+
+  // a modem reset forgets the socket settings
+  CHECK(modem.reset());
+  CHECK(modem.TCPconnect((char *)"10.0.0.1", 80));
+  checkSetups(sim, 2);
+
+  // so does losing the PDP context
+  sim.urc("+PDP: DEACT");
+  CHECK(modem.TCPconnect((char *)"10.0.0.1", 80));
+  checkSetups(sim, 3);
+
+  // and when the modem refuses the connection the setup is done again
+  sim.reply("AT+CIPSTART=", "\r\nERROR\r\n");
+  CHECK(!modem.TCPconnect((char *)"10.0.0.1", 80));
+  checkSetups(sim, 4);
+}
+
+int main()
+{
+  testReconnectSkipsSetup();
+  testSetupAgainWhenLost();
+
+  return checkResult("test_tcp_connect");
+}
@@ -0,0 +1,190 @@
+// TelemetryQueue: the ring, restoring it from storage, and batched uploads
+// through postHTTP against the simulated modem.
+
+#include "SimModem.h"
+#include "TelemetryQueue.h"
+
+// EEPROM-like storage in memory, erased to 0xFF.
+class MemoryStorage : public QueueStorage
+{
+public:
+        MemoryStorage(uint16_t size) : data(size, 0xFF), fail(false) {}
+
+        std::vector<uint8_t> data;
+        bool fail;
+
+        bool read(uint16_t address, uint8_t *p, uint16_t len)
+        {
+          CHECK(address + len <= data.size());
+          if (fail)
+            return false;
+          memcpy(p, &data[address], len);
+          return true;
+        }
+
+        bool write(uint16_t address, const uint8_t *p, uint16_t len)
+        {
+          CHECK(address + len <= data.size());
+          if (fail)
+            return false;
+          memcpy(&data[address], p, len);
+          return true;
+        }
+};
+
+static void status(SimModem &sim, uint16_t code)
+{
+  char reply[64];
+  snprintf(reply, sizeof(reply), "\r\nOK\r\n\r\n+HTTPACTION: 1,%u,0\r\n", code);
+  sim.reply("AT+HTTPACTION=1", reply);
+}
+
+static void push(TelemetryQueue &queue, int from, int to)
+{
+  char payload[8];
+  for (int i = from; i <= to; i++)
+  {
+    snprintf(payload, sizeof(payload), "%d", i);
+    CHECK(queue.push(payload));
+  }
+}
+
+static void testWrapDropsOldest()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  status(sim, 200);
+
+  char buffer[4 * 16];
+  TelemetryQueue queue(buffer, 4, 16);
+  CHECK(queue.begin());
+
+  push(queue, 1, 6);
+  CHECK(queue.count() == 4);
+  CHECK(queue.dropped() == 2);
+
+  // too long for a slot: refused, nothing dropped
+  CHECK(!queue.push("0123456789abcdef"));
+  CHECK(queue.dropped() == 2);
+
+  CHECK(queue.upload(modem, "http://example.com/t"));
+  CHECK(sim.httpBody == "[3,4,5,6]");
+  CHECK(queue.count() == 0);
+
+  // the ring goes on from where the head is
+  push(queue, 7, 9);
+  CHECK(queue.upload(modem, "http://example.com/t"));
+  CHECK(sim.httpBody == "[7,8,9]");
+}
+
+static void testRestoreAfterRestart()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  status(sim, 200);
+  MemoryStorage storage(2 + 4 * 16);
+
+  {
+    char buffer[4 * 16];
+    TelemetryQueue queue(buffer, 4, 16, &storage);
+    CHECK(queue.begin()); // erased storage: empty
+    CHECK(queue.count() == 0);
+
+    push(queue, 1, 6);
+    queue.setBatch(2);
+    CHECK(queue.upload(modem, "http://example.com/t"));
+    CHECK(sim.httpBody == "[3,4]");
+  }
+
+  // a reset: a new queue over the same storage, in a different buffer
+  char buffer[4 * 16];
+  memset(buffer, 'x', sizeof(buffer));
+  TelemetryQueue queue(buffer, 4, 16, &storage);
+  CHECK(queue.begin());
+  CHECK(queue.count() == 2);
+  CHECK(queue.upload(modem, "http://example.com/t"));
+  CHECK(sim.httpBody == "[5,6]");
+
+  // foreign content is not taken for a queue
+  MemoryStorage other(2 + 4 * 16);
+  other.data[0] = 9;
+  other.data[1] = 1;
+  TelemetryQueue fresh(buffer, 4, 16, &other);
+  CHECK(fresh.begin());
+  CHECK(fresh.count() == 0);
+  CHECK(other.data[0] == 0 && other.data[1] == 0);
+
+  // a storage that can't be read
+  other.fail = true;
+  CHECK(!fresh.begin());
+}
+
+static void testBatchesAcknowledged()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+
+  char buffer[8 * 16];
+  TelemetryQueue queue(buffer, 8, 16);
+  CHECK(queue.begin());
+  queue.setBatch(2);
+  push(queue, 1, 5);
+
+  // not acknowledged: kept
+  status(sim, 500);
+  CHECK(!queue.upload(modem, "http://example.com/t"));
+  CHECK(sim.httpBody == "[1,2]");
+  CHECK(queue.count() == 5);
+
+  // no answer at all
+  sim.reply("AT+HTTPACTION=1", "\r\nERROR\r\n");
+  CHECK(!queue.upload(modem, "http://example.com/t"));
+  CHECK(queue.count() == 5);
+
+  status(sim, 204);
+  uint32_t posts = sim.count("AT+HTTPACTION=1");
+  CHECK(queue.uploadAll(modem, "http://example.com/t"));
+  CHECK(sim.count("AT+HTTPACTION=1") - posts == 3);
+  CHECK(sim.httpBody == "[5]");
+  CHECK(queue.count() == 0);
+
+  // other framing: one payload per line
+  queue.setBatch(3, 0, '\n', 0);
+  push(queue, 6, 8);
+  CHECK(queue.upload(modem, "http://example.com/t"));
+  CHECK(sim.httpBody == "6\n7\n8");
+}
+
+// the batch is handed to postHTTP's callbacks through static members: two
+// queues uploading one after the other each send their own payloads
+static void testTwoQueues()
+{
+  SimModem sim;
+  TinySIM800 modem(sim);
+  status(sim, 200);
+
+  char bufferA[4 * 16], bufferB[4 * 16];
+  TelemetryQueue a(bufferA, 4, 16);
+  TelemetryQueue b(bufferB, 4, 16);
+  CHECK(a.begin());
+  CHECK(b.begin());
+  a.push("\"a\"");
+  b.push("\"b1\"");
+  b.push("\"b2\"");
+
+  CHECK(a.upload(modem, "http://example.com/a"));
+  CHECK(sim.httpBody == "[\"a\"]");
+  CHECK(b.upload(modem, "http://example.com/b"));
+  CHECK(sim.httpBody == "[\"b1\",\"b2\"]");
+  CHECK(a.count() == 0 && b.count() == 0);
+}
+
+int main()
+{
+  testWrapDropsOldest();
+  testRestoreAfterRestart();
+  testBatchesAcknowledged();
+  testTwoQueues();
+
+  return checkResult("test_telemetry_queue");
+}
@@ -0,0 +1,129 @@
+// A session with the simulated modem recorded through RecordingStream and
+// replayed to a second driver through ReplayStream.
+
+#include "SimModem.h"
+#include "TinySIM800.h"
+#include "TraceStream.h"
+
+// A trace file in memory: written by the recorder, read by the replay.
+class TraceBuffer : public Stream
+{
+public:
+        TraceBuffer() : pos(0) {}
+
+        std::string data;
+        size_t pos;
+
+        int available() { return data.size() - pos; }
+        int read() { return pos < data.size() ? (uint8_t)data[pos++] : -1; }
+        int peek() { return pos < data.size() ? (uint8_t)data[pos] : -1; }
+        size_t write(uint8_t b)
+        {
+          data += (char)b;
+          return 1;
+        }
+};
+
+struct Session
+{
+  uint8_t rssi;
+  uint32_t time;
+  bool registered;
+};
+
+static Session run(TinySIM800 &modem)
+{
+  Session s;
+  s.rssi = modem.getRSSI();
+  s.time = modem.now();
+  s.registered = modem.isRegistered();
+  return s;
+}
+
+static void record(SimModem &sim, TraceBuffer &trace, Session &recorded)
+{
+  sim.reply("AT+CSQ", "\r\n+CSQ: 17,0\r\n\r\nOK\r\n");
+  sim.reply("AT+CCLK?", "\r\n+CCLK: \"21/03/14,12:30:05+04\"\r\n\r\nOK\r\n");
+  sim.urc("+CREG: 1,\"1A2B\",\"00FF\"");
+
+  RecordingStream recorder(sim, trace);
+  TinySIM800 modem(recorder);
+  recorder.begin();
+  recorded = run(modem);
+  recorder.end();
+}
+
+static void testRoundTrip()
+{
+  SimModem sim;
+  TraceBuffer trace;
+  Session recorded;
+  record(sim, trace, recorded);
+
+  CHECK(recorded.rssi == 17);
+  CHECK(recorded.time == 1615721405); // 12:30:05 at UTC+1
+  CHECK(recorded.registered);
+  CHECK(trace.data.compare(0, 5, "SIMT\x01") == 0);
+
+  ReplayStream replay(trace);
+  CHECK(replay.begin());
+  TinySIM800 modem(replay);
+  Session replayed = run(modem);
+
+  CHECK(replayed.rssi == recorded.rssi);
+  CHECK(replayed.time == recorded.time);
+  CHECK(replayed.registered == recorded.registered);
+  CHECK(replay.mismatches() == 0);
+  CHECK(replay.finished());
+}
+
+// a driver that sends something else than was recorded is noticed
+static void testMismatch()
+{
+  SimModem sim;
+  TraceBuffer trace;
+  Session recorded;
+  record(sim, trace, recorded);
+
+  ReplayStream replay(trace);
+  CHECK(replay.begin());
+  TinySIM800 modem(replay);
+  modem.enableGNSS(true);
+
+  CHECK(replay.mismatches() > 0);
+}
+
+// records hold at most TRACE_MAX_RECORD bytes and carry the time since the
+// previous one
+static void testRecords()
+{
+  SimModem sim;
+  TraceBuffer trace;
+  RecordingStream recorder(sim, trace);
+  recorder.begin();
+
+  for (int i = 0; i < 200; i++)
+    recorder.write('a');
+  advanceClock(1000);
+  recorder.write('b');
+  recorder.end();
+
+  const std::string &t = trace.data;
+  CHECK(t.size() == 5 + 2 + 128 + 2 + 72 + 3 + 1);
+  CHECK((uint8_t)t[5] == 127); // to the modem, 128 bytes
+  CHECK((uint8_t)t[5 + 2 + 128] == 71);
+  size_t last = 5 + 2 + 128 + 2 + 72;
+  CHECK((uint8_t)t[last] == 0);
+  uint32_t delta = ((uint8_t)t[last + 1] & 0x7F) | ((uint8_t)t[last + 2] << 7);
+  CHECK(delta >= 1000 && delta < 1010);
+  CHECK(t[last + 3] == 'b');
+}
+
+int main()
+{
+  testRoundTrip();
+  testMismatch();
+  testRecords();
+
+  return checkResult("test_trace");
+}